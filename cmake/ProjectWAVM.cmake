@@ -9,6 +9,9 @@ find_package(LLVM 6.0 REQUIRED CONFIG)
 message(STATUS "LLVM: ${LLVM_DIR}")
 llvm_map_components_to_libnames(llvm_libs support core passes mcjit native DebugInfoDWARF)
 
+# Also identifies the format of the precompiled artifacts (see ArtifactStore).
+set(WAVM_VERSION fa5434e03efbc2154ecf4aafede169da76a4da40)
+
 set(prefix ${CMAKE_BINARY_DIR}/deps)
 set(source_dir ${prefix}/src/wavm)
 set(binary_dir ${prefix}/src/wavm-build)
@@ -32,7 +35,7 @@ ExternalProject_Add(wavm
     DOWNLOAD_DIR ${prefix}/downloads
     SOURCE_DIR ${source_dir}
     BINARY_DIR ${binary_dir}
-    URL https://github.com/AndrewScheidecker/WAVM/archive/fa5434e03efbc2154ecf4aafede169da76a4da40.tar.gz
+    URL https://github.com/AndrewScheidecker/WAVM/archive/${WAVM_VERSION}.tar.gz
     URL_HASH SHA256=1a380461ca6570b39d548dcedfacb3c105769d5d5957e85674253250f585c07d
     PATCH_COMMAND sh ${CMAKE_CURRENT_LIST_DIR}/patch_wavm.sh
     CMAKE_ARGS
@@ -5,13 +5,16 @@ set(ProjectWasmerIncluded TRUE)
 include(ExternalProject)
 include(GNUInstallDirs)
 
+# Also identifies the format of the serialized artifacts (see ArtifactStore).
+set(WASMER_VERSION 63a2d8129c7ad5ca670d041859de45e01292dd12)
+
 # TODO: if find LLVM 8.0+ use make capi-llvm to get better permformance
 set(WASMER_BUILD_COMMAND make capi)
 ExternalProject_Add(wasmer
         PREFIX ${CMAKE_SOURCE_DIR}/deps
         DOWNLOAD_NO_PROGRESS 1
         GIT_REPOSITORY https://github.com/wasmerio/wasmer.git
-        GIT_TAG 63a2d8129c7ad5ca670d041859de45e01292dd12
+        GIT_TAG ${WASMER_VERSION}
         BUILD_IN_SOURCE 1
         CONFIGURE_COMMAND ""
         BUILD_COMMAND ${WASMER_BUILD_COMMAND}
@@ -26,6 +26,47 @@ extern "C" {
 
 EVMC_EXPORT struct evmc_vm* evmc_create_hera(void) EVMC_NOEXCEPT;
 
+/// Dumps the counters collected with the "metrics" option, in the "json" or "prometheus" text format.
+/// The dump is written, NUL-terminated, to @buffer if it is larger than the dump.
+/// Returns the size of the dump (like snprintf), or 0 if the format is unknown.
+EVMC_EXPORT size_t hera_dump_metrics(char const* format, char* buffer, size_t buffer_size) EVMC_NOEXCEPT;
+
+/// A message of a batch, with the code to execute for it (see hera_execute_batch).
+struct hera_batch_message {
+  struct evmc_message const* message;
+  uint8_t const* code;
+  size_t code_size;
+};
+
+/// Executes @count @messages as if each was passed to evmc_vm::execute with the same host
+/// and revision, and writes their results to @results, which the caller has to release.
+/// Messages with the same code are executed one after another on the same thread, so they
+/// share the hash of the code and its cached module. With @threads above 1 up to that many
+/// groups of messages are executed concurrently, which is only valid if the messages are
+/// independent (e.g. read-only calls) and the host can be used from multiple threads.
+EVMC_EXPORT void hera_execute_batch(
+  struct evmc_vm* vm,
+  struct evmc_host_interface const* host,
+  struct evmc_host_context* context,
+  enum evmc_revision rev,
+  struct hera_batch_message const* messages,
+  size_t count,
+  struct evmc_result* results,
+  size_t threads
+) EVMC_NOEXCEPT;
+
+/// The code of a contract (see hera_warm_up).
+struct hera_code {
+  uint8_t const* code;
+  size_t code_size;
+};
+
+/// Validates @count deployed contract @codes like a deployment would and fills the caches of the
+/// engine with what executing them needs (natively metered if enabled, compiled by compiling
+/// engines), using up to @threads threads. Meant for startup, after the options are set.
+/// Returns the number of codes accepted, the others are invalid or not WebAssembly.
+EVMC_EXPORT size_t hera_warm_up(struct evmc_vm* vm, struct hera_code const* codes, size_t count, size_t threads) EVMC_NOEXCEPT;
+
 #if __cplusplus
 }
 #endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <hera/buildinfo.h>
+
+#include "artifact_store.h"
+#include "debugging.h"
+#include "keccak.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+constexpr char artifactMagic[] = "hera-artifact 2\n";
+
+// The header is followed by the Keccak-256 hash of the payload.
+constexpr size_t payloadHashSize = sizeof(evmc::bytes32);
+
+bool writeAll(int fd, void const* data, size_t size) noexcept
+{
+  auto ptr = static_cast<char const*>(data);
+  while (size > 0) {
+    ssize_t written = ::write(fd, ptr, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    ptr += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+}
+
+MappedArtifact::~MappedArtifact() noexcept
+{
+  ::munmap(m_mapping, m_mappingSize);
+}
+
+ArtifactStore::ArtifactStore(string engine, string engineVersion):
+  m_engine(move(engine))
+{
+  auto const* info = hera_get_buildinfo();
+  m_header = string(artifactMagic) +
+    info->project_version + "\n" +
+    info->git_commit_hash + "\n" +
+    m_engine + " " + engineVersion + "\n";
+}
+
+string ArtifactStore::path(CodeHash const& hash) const
+{
+  // Skip the "0x" prefix.
+  return m_directory + "/" + toHex(hash).substr(2) + "." + m_engine;
+}
+
+unique_ptr<MappedArtifact> ArtifactStore::load(CodeHash const& hash) const
+{
+  if (!enabled())
+    return {};
+
+  int fd = ::open(path(hash).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return {};
+
+  struct stat st;
+  size_t const payloadOffset = m_header.size() + payloadHashSize;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= payloadOffset) {
+    ::close(fd);
+    return {};
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after closing the descriptor.
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    return {};
+
+  auto artifact = make_unique<MappedArtifact>(mapping, size, payloadOffset);
+  auto const* data = static_cast<uint8_t const*>(mapping);
+  if (memcmp(data, m_header.data(), m_header.size()) != 0) {
+    HERA_DEBUG << "Ignoring stale artifact " << path(hash) << "\n";
+    return {};
+  }
+  // Object code is run as is, so a truncated or altered payload must not be loaded.
+  evmc::bytes32 payloadHash = keccak256(artifact->payload());
+  if (memcmp(data + m_header.size(), payloadHash.bytes, payloadHashSize) != 0) {
+    HERA_DEBUG << "Ignoring corrupt artifact " << path(hash) << "\n";
+    return {};
+  }
+  return artifact;
+}
+
+void ArtifactStore::save(CodeHash const& hash, bytes_view payload) const noexcept
+{
+  if (!enabled())
+    return;
+
+  try {
+    // Only the last component is created, the parent is expected to exist.
+    if (::mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST)
+      return;
+
+    // Write to a unique temporary file and rename it into place, so that concurrent
+    // writers and crashes never leave a truncated artifact behind.
+    string target = path(hash);
+    string temporary = target + ".XXXXXX";
+    int fd = ::mkstemp(&temporary[0]);
+    if (fd < 0)
+      return;
+
+    evmc::bytes32 payloadHash = keccak256(payload);
+    bool ok = writeAll(fd, m_header.data(), m_header.size()) &&
+      writeAll(fd, payloadHash.bytes, payloadHashSize) &&
+      writeAll(fd, payload.data(), payload.size());
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(temporary.c_str(), target.c_str()) != 0) {
+      ::unlink(temporary.c_str());
+      return;
+    }
+    HERA_DEBUG << "Stored artifact " << target << "\n";
+  } catch (...) {
+    // Persisting is best effort.
+  }
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "cache.h"
+#include "helpers.h"
+
+namespace hera {
+
+/// A read-only memory mapping of a stored artifact.
+class MappedArtifact {
+public:
+  MappedArtifact(void* mapping, size_t mappingSize, size_t payloadOffset) noexcept:
+    m_mapping(mapping), m_mappingSize(mappingSize), m_payloadOffset(payloadOffset)
+  {}
+  ~MappedArtifact() noexcept;
+
+  MappedArtifact(MappedArtifact const&) = delete;
+  MappedArtifact& operator=(MappedArtifact const&) = delete;
+
+  bytes_view payload() const noexcept
+  {
+    return {static_cast<uint8_t const*>(m_mapping) + m_payloadOffset, m_mappingSize - m_payloadOffset};
+  }
+
+private:
+  void* m_mapping;
+  size_t m_mappingSize;
+  size_t m_payloadOffset;
+};
+
+/// Content-addressed directory of compiled contracts, stored as `<dir>/<code hash>.<engine>`.
+///
+/// Every artifact starts with a header naming the Hera build and the engine version
+/// which produced it. Artifacts with a different header are ignored (and replaced on
+/// the next save), so upgrading either never loads stale object code. The header is
+/// followed by the hash of the payload, which is checked on every load.
+/// The store is disabled until a directory is set.
+class ArtifactStore {
+public:
+  /// @engine is used as the file extension, @engineVersion should change whenever the artifact format does.
+  ArtifactStore(std::string engine, std::string engineVersion);
+
+  void setDirectory(std::string directory) { m_directory = std::move(directory); }
+  bool enabled() const noexcept { return !m_directory.empty(); }
+
+  /// Maps the artifact for @hash, or returns nullptr if it is missing, stale or corrupt.
+  std::unique_ptr<MappedArtifact> load(CodeHash const& hash) const;
+
+  /// Stores @payload for @hash. Failures are not fatal, the artifact is simply not persisted.
+  void save(CodeHash const& hash, bytes_view payload) const noexcept;
+
+private:
+  std::string path(CodeHash const& hash) const;
+
+  std::string m_engine;
+  std::string m_header;
+  std::string m_directory;
+};
+
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "benchmark_log.h"
+#include "helpers.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+char const* kindName(evmc_call_kind kind) noexcept
+{
+  switch (kind) {
+  case EVMC_CALL: return "call";
+  case EVMC_DELEGATECALL: return "delegatecall";
+  case EVMC_CALLCODE: return "callcode";
+  case EVMC_CREATE: return "create";
+  case EVMC_CREATE2: return "create2";
+  }
+  return "unknown";
+}
+
+// A bounded multi-producer queue, where each cell carries a sequence number telling
+// whether it is free for the producer or filled for the consumer of that position.
+class RecordQueue {
+public:
+  RecordQueue() noexcept
+  {
+    for (size_t i = 0; i < capacity; ++i)
+      m_cells[i].sequence.store(i, memory_order_relaxed);
+  }
+
+  bool push(BenchmarkRecord const& record) noexcept
+  {
+    size_t position = m_tail.load(memory_order_relaxed);
+    while (true) {
+      Cell& cell = m_cells[position % capacity];
+      size_t sequence = cell.sequence.load(memory_order_acquire);
+      if (sequence == position) {
+        if (m_tail.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+          cell.record = record;
+          cell.sequence.store(position + 1, memory_order_release);
+          return true;
+        }
+      } else if (sequence < position) {
+        // The consumer has not freed the cell yet, the queue is full.
+        return false;
+      } else {
+        position = m_tail.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  // Only called by the single consumer.
+  bool pop(BenchmarkRecord& record) noexcept
+  {
+    Cell& cell = m_cells[m_head % capacity];
+    if (cell.sequence.load(memory_order_acquire) != m_head + 1)
+      return false;
+    record = cell.record;
+    cell.sequence.store(m_head + capacity, memory_order_release);
+    ++m_head;
+    return true;
+  }
+
+private:
+  static constexpr size_t capacity = 4096;
+
+  struct Cell {
+    atomic<size_t> sequence;
+    BenchmarkRecord record;
+  };
+
+  array<Cell, capacity> m_cells;
+  alignas(64) atomic<size_t> m_tail{0};
+  alignas(64) size_t m_head = 0;
+};
+
+class BenchmarkLog {
+public:
+  BenchmarkLog(): m_writer([this] { write(); }) {}
+
+  ~BenchmarkLog() noexcept
+  {
+    m_stop = true;
+    m_writer.join();
+  }
+
+  void push(BenchmarkRecord const& record) noexcept
+  {
+    if (!m_queue.push(record))
+      m_dropped.fetch_add(1, memory_order_relaxed);
+  }
+
+private:
+  void write()
+  {
+    bool empty = ifstream{"hera_benchmarks.log", ios::ate}.tellg() <= 0;
+    ofstream file{"hera_benchmarks.log", ios::out | ios::app};
+    if (empty)
+      file << "code_hash,kind,depth,gas_used,instantiation_ns,execution_ns\n";
+
+    uint64_t reportedDropped = 0;
+    // Whatever is queued when stopping is still written.
+    for (bool stopping = false; !stopping;) {
+      stopping = m_stop;
+      BenchmarkRecord record;
+      while (m_queue.pop(record))
+        file << toHex(record.codeHash) << ',' << kindName(record.kind) << ',' << record.depth << ','
+             << record.gasUsed << ',' << record.instantiationNanoseconds << ',' << record.executionNanoseconds << '\n';
+      file.flush();
+
+      uint64_t dropped = m_dropped.load(memory_order_relaxed);
+      if (dropped != reportedDropped) {
+        cerr << "Hera: " << (dropped - reportedDropped) << " benchmark records dropped, the log writer is behind.\n";
+        reportedDropped = dropped;
+      }
+
+      if (!stopping)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+  }
+
+  RecordQueue m_queue;
+  atomic<uint64_t> m_dropped{0};
+  atomic<bool> m_stop{false};
+  // Declared last, as it uses the members above.
+  thread m_writer;
+};
+
+}
+
+void logBenchmark(BenchmarkRecord const& record) noexcept
+{
+  try {
+    static BenchmarkLog log;
+    log.push(record);
+  } catch (...) {
+    // The writer thread could not be started, benchmarking is best effort.
+  }
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <evmc/evmc.h>
+
+#include "cache.h"
+
+namespace hera {
+
+struct BenchmarkRecord {
+  CodeHash codeHash;
+  evmc_call_kind kind;
+  int32_t depth;
+  int64_t gasUsed;
+  int64_t instantiationNanoseconds;
+  int64_t executionNanoseconds;
+};
+
+/// Queues @record for `hera_benchmarks.log` (a CSV file, appended to).
+///
+/// Records go through a bounded lock-free queue, which a background thread (started
+/// on first use) drains to the file, so the executing thread never blocks or does I/O.
+/// If the writer falls behind, records are dropped and the number dropped is reported.
+void logBenchmark(BenchmarkRecord const& record) noexcept;
+
+}
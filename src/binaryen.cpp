@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <unordered_map>
 #include <vector>
 
 #include <pass.h>
@@ -27,7 +28,10 @@
 #include "binaryen.h"
 #include "debugging.h"
 #include "eei.h"
+#include "eei_table.h"
 #include "exceptions.h"
+#include "keccak.h"
+#include "metrics.h"
 
 #include "shell-interface.h"
 
@@ -42,13 +46,17 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _cacheStorage
   ):
     ShellExternalInterface(),
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _cacheStorage)
   { }
 
+  void setMemoryReservation(MemoryReservation const& reservation) noexcept { m_memoryReservation = &reservation; }
+
 protected:
+  void init(wasm::Module& wasm, wasm::ModuleInstance& instance) override;
   wasm::Literal callImport(wasm::Import *import, wasm::LiteralList& arguments) override;
 #if HERA_DEBUGGING
   wasm::Literal callDebugImport(wasm::Import *import, wasm::LiteralList& arguments);
@@ -60,6 +68,13 @@ protected:
     ensureCondition(false, VMTrap, why);
   }
 
+  void growMemory(wasm::Address oldSize, wasm::Address newSize) override {
+    // The sizes are in bytes.
+    if (m_memoryReservation)
+      m_memoryReservation->checkLimit(newSize / wasm::Memory::kPageSize);
+    ShellExternalInterface::growMemory(oldSize, newSize);
+  }
+
 private:
   size_t memorySize() const override { return memory.size(); }
   void memorySet(size_t offset, uint8_t value) override { memory.set<uint8_t>(offset, value); }
@@ -68,8 +83,22 @@ private:
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
     return reinterpret_cast<uint8_t*>(memory.rawpointer(offset));
   }
+
+  // The host functions of the imports, resolved once when instantiating.
+  unordered_map<wasm::Import*, EEIFunction const*> m_importFunctions;
+  MemoryReservation const* m_memoryReservation = nullptr;
 };
 
+  void BinaryenEthereumInterface::init(wasm::Module& wasm, wasm::ModuleInstance& instance) {
+    ShellExternalInterface::init(wasm, instance);
+    for (auto const& import: wasm.imports) {
+      if (import->module != wasm::Name("ethereum"))
+        continue;
+      if (EEIFunction const* function = findEEIFunction(import->base.str))
+        m_importFunctions.emplace(import.get(), function);
+    }
+  }
+
   void BinaryenEthereumInterface::importGlobals(map<wasm::Name, wasm::Literal>& globals, wasm::Module& wasm) {
     (void)globals;
     (void)wasm;
@@ -145,329 +174,31 @@ private:
       return callDebugImport(import, arguments);
 #endif
 
-    heraAssert(import->module == wasm::Name("ethereum"), "Only imports from the 'ethereum' namespace are allowed.");
-
-    if (import->base == wasm::Name("useGas")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      int64_t gas = arguments[0].geti64();
-
-      eeiUseGas(gas);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getGasLeft")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetGasLeft());
-    }
-
-    if (import->base == wasm::Name("getAddress")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetAddress(resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getExternalBalance")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
-
-      eeiGetExternalBalance(addressOffset, resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getBlockHash")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint64_t number = static_cast<uint64_t>(arguments[0].geti64());
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
-
-      return wasm::Literal(eeiGetBlockHash(number, resultOffset));
-    }
-
-    if (import->base == wasm::Name("getCallDataSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetCallDataSize());
-    }
-
-    if (import->base == wasm::Name("callDataCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t dataOffset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
-
-      eeiCallDataCopy(resultOffset, dataOffset, length);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getCaller")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetCaller(resultOffset);
+    auto it = m_importFunctions.find(import);
+    heraAssert(it != m_importFunctions.end(), string("Unsupported import called: ") + import->module.str + "::" + import->base.str + " (" + to_string(arguments.size()) + "arguments)");
+    EEIFunction const& function = *it->second;
+    heraAssert(arguments.size() == function.paramCount, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getCallValue")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetCallValue(resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("codeCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t codeOffset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
-
-      eeiCodeCopy(resultOffset, codeOffset, length);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getCodeSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetCodeSize());
-    }
-
-    if (import->base == wasm::Name("externalCodeCopy")) {
-      heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t codeOffset = static_cast<uint32_t>(arguments[2].geti32());
-      uint32_t length = static_cast<uint32_t>(arguments[3].geti32());
-
-      eeiExternalCodeCopy(addressOffset, resultOffset, codeOffset, length);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getExternalCodeSize")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      return wasm::Literal(eeiGetExternalCodeSize(addressOffset));
-    }
-
-    if (import->base == wasm::Name("getBlockCoinbase")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetBlockCoinbase(resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getBlockDifficulty")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetBlockDifficulty(offset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getBlockGasLimit")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetBlockGasLimit());
-    }
-
-    if (import->base == wasm::Name("getTxGasPrice")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetTxGasPrice(valueOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("log")) {
-      heraAssert(arguments.size() == 7, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t length = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t numberOfTopics = static_cast<uint32_t>(arguments[2].geti32());
-      uint32_t topic1 = static_cast<uint32_t>(arguments[3].geti32());
-      uint32_t topic2 = static_cast<uint32_t>(arguments[4].geti32());
-      uint32_t topic3 = static_cast<uint32_t>(arguments[5].geti32());
-      uint32_t topic4 = static_cast<uint32_t>(arguments[6].geti32());
-
-      eeiLog(dataOffset, length, numberOfTopics, topic1, topic2, topic3, topic4);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("getBlockNumber")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetBlockNumber());
-    }
-
-    if (import->base == wasm::Name("getBlockTimestamp")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetBlockTimestamp());
-    }
-
-    if (import->base == wasm::Name("getTxOrigin")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
-
-      eeiGetTxOrigin(resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("storageStore")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t valueOffset = static_cast<uint32_t>(arguments[1].geti32());
-
-      eeiStorageStore(pathOffset, valueOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("storageLoad")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
-
-      eeiStorageLoad(pathOffset, resultOffset);
-
-      return wasm::Literal();
-    }
-
-    if (import->base == wasm::Name("finish")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
-
-      // This traps.
-      eeiFinish(offset, size);
-    }
-
-    if (import->base == wasm::Name("revert")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
-
-      // This traps.
-      eeiRevert(offset, size);
-    }
-
-    if (import->base == wasm::Name("getReturnDataSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
-      return wasm::Literal(eeiGetReturnDataSize());
-    }
-
-    if (import->base == wasm::Name("returnDataCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t offset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t size = static_cast<uint32_t>(arguments[2].geti32());
-
-      eeiReturnDataCopy(dataOffset, offset, size);
-
-      return wasm::Literal();
-    }
-
-    if (
-      import->base == wasm::Name("call") ||
-      import->base == wasm::Name("callCode") ||
-      import->base == wasm::Name("callDelegate") ||
-      import->base == wasm::Name("callStatic")
-    ) {
-      EEICallKind kind;
-      if (import->base == wasm::Name("call"))
-        kind = EEICallKind::Call;
-      else if (import->base == wasm::Name("callCode"))
-        kind = EEICallKind::CallCode;
-      else if (import->base == wasm::Name("callDelegate"))
-        kind = EEICallKind::CallDelegate;
-      else if (import->base == wasm::Name("callStatic"))
-        kind = EEICallKind::CallStatic;
+    uint64_t args[maxEEIParams];
+    for (size_t i = 0; i < function.paramCount; ++i) {
+      if (function.params[i] == EEIValueType::i64)
+        args[i] = static_cast<uint64_t>(arguments[i].geti64());
       else
-        heraAssert(false, "");
-
-      if ((kind == EEICallKind::Call) || (kind == EEICallKind::CallCode)) {
-        heraAssert(arguments.size() == 5, string("Argument count mismatch in: ") + import->base.str);
-      } else {
-        heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-      }
-
-      int64_t gas = arguments[0].geti64();
-      uint32_t addressOffset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t valueOffset;
-      uint32_t dataOffset;
-      uint32_t dataLength;
-
-      if (kind == EEICallKind::Call || kind == EEICallKind::CallCode) {
-        valueOffset = static_cast<uint32_t>(arguments[2].geti32());
-        dataOffset = static_cast<uint32_t>(arguments[3].geti32());
-        dataLength = static_cast<uint32_t>(arguments[4].geti32());
-      } else {
-        valueOffset = 0;
-        dataOffset = static_cast<uint32_t>(arguments[2].geti32());
-        dataLength = static_cast<uint32_t>(arguments[3].geti32());
-      }
-
-      return wasm::Literal(eeiCall(kind, gas, addressOffset, valueOffset, dataOffset, dataLength));
-    }
-
-    if (import->base == wasm::Name("create")) {
-      heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
-      uint32_t dataOffset = static_cast<uint32_t>(arguments[1].geti32());
-      uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
-      uint32_t resultOffset = static_cast<uint32_t>(arguments[3].geti32());
-
-      return wasm::Literal(eeiCreate(valueOffset, dataOffset, length, resultOffset));
+        args[i] = static_cast<uint32_t>(arguments[i].geti32());
     }
 
-    if (import->base == wasm::Name("selfDestruct")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
-      uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
+    // Finishing, reverting and self-destructing trap.
+    uint64_t ret = function.call(static_cast<EthereumInterface&>(*this), args);
 
-      // This traps.
-      eeiSelfDestruct(addressOffset);
+    switch (function.result) {
+    case EEIValueType::i32:
+      return wasm::Literal(static_cast<uint32_t>(ret));
+    case EEIValueType::i64:
+      return wasm::Literal(static_cast<int64_t>(ret));
+    case EEIValueType::none:
+      break;
     }
-
-    heraAssert(false, string("Unsupported import called: ") + import->module.str + "::" + import->base.str + " (" + to_string(arguments.size()) + "arguments)");
+    return wasm::Literal();
   }
 
 unique_ptr<WasmEngine> BinaryenEngine::create()
@@ -483,26 +214,25 @@ ExecutionResult BinaryenEngine::execute(
   evmc_message const& msg,
   bool meterInterfaceGas
 ) {
-  instantiationStarted();
-  wasm::Module module;
-
-  // Load module
-  loadModule(code, module);
-
-  // Print
-  // WasmPrinter::printModule(module);
-
-  // Validate
-  verifyContract(module);
+  BenchmarkTimer timer = instantiationStarted();
+  shared_ptr<wasm::Module> module = verifiedModule(code);
 
   // NOTE: DO NOT use the optimiser here, it will conflict with metering
 
   // Interpret
+  PhaseTimer phases;
+  phases.start(Phase::instantiate);
+  MemoryReservation reservation{memoryBudget, module->memory.initial, module->memory.max};
   ExecutionResult result;
-  BinaryenEthereumInterface interface(context, state_code, msg, result, meterInterfaceGas);
-  wasm::ModuleInstance instance(module, &interface);
+  BinaryenEthereumInterface interface(context, state_code, msg, result, meterInterfaceGas, storageCacheEnabled);
+  interface.setMemoryReservation(reservation);
+  // Growing beyond the limit traps (see growMemory), so only that much is mapped.
+  if (memoryBudget && memoryBudget->executionLimit())
+    interface.limitMemory(memoryBudget->limitMaximum(module->memory.max));
+  wasm::ModuleInstance instance(*module, &interface);
 
-  executionStarted();
+  timer.executionStarted();
+  phases.start(Phase::execute);
 
   try {
     wasm::Name main = wasm::Name("main");
@@ -513,7 +243,8 @@ ExecutionResult BinaryenEngine::execute(
     // It is only a clutch for POSIX style exit()
   }
 
-  executionFinished();
+  phases.stop();
+  timer.executionFinished(result);
   return result;
 }
 
@@ -522,7 +253,9 @@ void BinaryenEngine::loadModule(bytes_view code, wasm::Module& module)
   try {
     auto const b = reinterpret_cast<char const*>(code.begin());
     auto const e = reinterpret_cast<char const*>(code.end());
-    std::vector<char> codeCopy{b, e};
+    // The parser only accepts a vector, so a copy cannot be avoided, but its allocation is reused.
+    thread_local std::vector<char> codeCopy;
+    codeCopy.assign(b, e);
     wasm::WasmBinaryBuilder parser(module, codeCopy, false);
     parser.read();
   } catch (wasm::ParseException const& e) {
@@ -535,16 +268,59 @@ void BinaryenEngine::loadModule(bytes_view code, wasm::Module& module)
 
 void BinaryenEngine::verifyContract(bytes_view code)
 {
-  wasm::Module module;
-  loadModule(code, module);
-  verifyContract(module);
+  // The module is kept in the module cache, so the first execution of the contract skips parsing it.
+  verifiedModule(code);
+}
+
+shared_ptr<wasm::Module> BinaryenEngine::verifiedModule(bytes_view code)
+{
+  bool const useCache = m_moduleCache.capacity() > 0;
+  CodeHash codeHash{};
+  if (useCache) {
+    codeHash = codeHashOf(code);
+    if (auto cached = m_moduleCache.find(codeHash)) {
+      HERA_DEBUG << "Using cached module.\n";
+      return cached;
+    }
+  }
+
+  PhaseTimer phases;
+  auto module = make_shared<wasm::Module>();
+
+  // Load module
+  phases.start(Phase::parse);
+  loadModule(code, *module);
+
+  // Print
+  // WasmPrinter::printModule(*module);
+
+  // Validate
+  phases.start(Phase::validate);
+  verifyContract(*module);
+
+  if (useCache)
+    m_moduleCache.insert(codeHash, module);
+  return module;
 }
 
 namespace {
-wasm::FunctionType createFunctionType(vector<wasm::Type> params, wasm::Type result) {
+wasm::Type toBinaryenType(EEIValueType type) {
+  switch (type) {
+  case EEIValueType::i32:
+    return wasm::Type::i32;
+  case EEIValueType::i64:
+    return wasm::Type::i64;
+  case EEIValueType::none:
+    break;
+  }
+  return wasm::Type::none;
+}
+
+wasm::FunctionType createFunctionType(EEIFunction const& function) {
   wasm::FunctionType ret;
-  ret.params = move(params);
-  ret.result = move(result);
+  for (size_t i = 0; i < function.paramCount; ++i)
+    ret.params.push_back(toBinaryenType(function.params[i]));
+  ret.result = toBinaryenType(function.result);
   return ret;
 }
 }
@@ -599,42 +375,6 @@ void BinaryenEngine::verifyContract(wasm::Module & module)
     "Contract is invalid. \"main\" has an invalid signature."
   );
 
-  static const map<wasm::Name const, wasm::FunctionType const> eei_signatures{
-    { wasm::Name("useGas"), createFunctionType({ wasm::Type::i64 }, wasm::Type::none) },
-    { wasm::Name("getGasLeft"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getAddress"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getExternalBalance"), createFunctionType({ wasm::Type::i32,wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockHash"), createFunctionType({ wasm::Type::i64, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("getCallDataSize"), createFunctionType({}, wasm::Type::i32) },
-    { wasm::Name("callDataCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getCaller"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getCallValue"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("codeCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("getCodeSize"), createFunctionType({}, wasm::Type::i32) },
-    { wasm::Name("externalCodeCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getExternalCodeSize"), createFunctionType({ wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("getBlockCoinbase"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockDifficulty"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockGasLimit"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getTxGasPrice"), createFunctionType({ wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("log"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockNumber"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getBlockTimestamp"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getTxOrigin"), createFunctionType({ wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("storageStore"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("storageLoad"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("finish"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("revert"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getReturnDataSize"), createFunctionType({ }, wasm::Type::i32) },
-    { wasm::Name("returnDataCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("call"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callCode"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callDelegate"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callStatic"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("create"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("selfDestruct"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) }
-  };
-
   for (auto const& import: module.imports) {
 #if HERA_DEBUGGING
     if (import->module == wasm::Name("debug"))
@@ -647,13 +387,14 @@ void BinaryenEngine::verifyContract(wasm::Module & module)
       "Import from invalid namespace."
     );
 
+    EEIFunction const* eei_function = findEEIFunction(import->base.str);
     ensureCondition(
-      eei_signatures.count(import->base),
+      eei_function,
       ContractValidationFailure,
       "Importing invalid EEI method."
     );
-    // NOTE: needs to be a copy by value due to `structuralComparison` requiring a non-const input
-    wasm::FunctionType eei_function_type = eei_signatures.at(import->base);
+    // NOTE: needs to be a non-const value due to `structuralComparison` requiring a non-const input
+    wasm::FunctionType eei_function_type = createFunctionType(*eei_function);
 
     wasm::FunctionType* function_type = module.getFunctionTypeOrNull(import->functionType);
     ensureCondition(
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "cache.h"
 #include "eei.h"
 
 namespace wasm {
@@ -39,12 +40,20 @@ public:
 
   void verifyContract(bytes_view code) override;
 
+  void setModuleCacheSize(size_t size) override { m_moduleCache.setCapacity(size); }
+
 private:
   void verifyContract(wasm::Module& module);
 
   /// Parses and loads a Wasm module.
   /// Don't ask, Module has no copy constructor, hence the reference.
   void loadModule(bytes_view code, wasm::Module& module);
+
+  /// Returns the parsed and validated module, reusing it from the module cache if possible.
+  /// The interpreter does not modify it, hence it is shared by all executions of the code.
+  std::shared_ptr<wasm::Module> verifiedModule(bytes_view code);
+
+  ShardedLruCache<CodeHash, wasm::Module, CodeHashHasher> m_moduleCache;
 };
 
 }
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "buffer_pool.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+constexpr size_t maxPooledBuffers = 16;
+// Larger buffers are given back to the allocator, so that a single big
+// return value does not stay allocated for the lifetime of the thread.
+constexpr size_t maxPooledCapacity = 1024 * 1024;
+
+// Output buffers are preceded by their capacity, so they can be handed out as a plain pointer.
+struct alignas(max_align_t) OutputBufferHeader {
+  size_t capacity;
+};
+
+struct ThreadBufferPool {
+  vector<bytes> buffers;
+  vector<OutputBufferHeader*> outputBuffers;
+
+  ~ThreadBufferPool()
+  {
+    for (OutputBufferHeader* header: outputBuffers)
+      ::operator delete(header);
+  }
+};
+
+thread_local ThreadBufferPool threadPool;
+
+}
+
+bytes acquireBuffer() noexcept
+{
+  auto& buffers = threadPool.buffers;
+  if (buffers.empty())
+    return {};
+  bytes ret = move(buffers.back());
+  buffers.pop_back();
+  return ret;
+}
+
+void releaseBuffer(bytes&& buffer) noexcept
+{
+  auto& buffers = threadPool.buffers;
+  if (buffer.capacity() > maxPooledCapacity || buffers.size() >= maxPooledBuffers)
+    return;
+  try {
+    buffer.clear();
+    buffers.push_back(move(buffer));
+  } catch (...) {
+    // The buffer is simply freed.
+  }
+}
+
+uint8_t* acquireOutputBuffer(size_t size)
+{
+  // Best fit, so that small outputs do not take the buffers kept for large ones.
+  auto& outputBuffers = threadPool.outputBuffers;
+  auto best = outputBuffers.end();
+  for (auto it = outputBuffers.begin(); it != outputBuffers.end(); ++it) {
+    if ((*it)->capacity >= size && (best == outputBuffers.end() || (*it)->capacity < (*best)->capacity))
+      best = it;
+  }
+  if (best != outputBuffers.end()) {
+    OutputBufferHeader* header = *best;
+    // The order of the pool does not matter.
+    *best = outputBuffers.back();
+    outputBuffers.pop_back();
+    return reinterpret_cast<uint8_t*>(header + 1);
+  }
+
+  // Round up, so that the buffer can be reused for slightly larger outputs.
+  size_t capacity = (size + 255) & ~size_t(255);
+  void* block = ::operator new(sizeof(OutputBufferHeader) + capacity);
+  OutputBufferHeader* header = new (block) OutputBufferHeader{capacity};
+  return reinterpret_cast<uint8_t*>(header + 1);
+}
+
+void releaseOutputBuffer(uint8_t const* buffer) noexcept
+{
+  auto header = reinterpret_cast<OutputBufferHeader*>(const_cast<uint8_t*>(buffer)) - 1;
+  auto& outputBuffers = threadPool.outputBuffers;
+  if (header->capacity <= maxPooledCapacity && outputBuffers.size() < maxPooledBuffers) {
+    try {
+      outputBuffers.push_back(header);
+      return;
+    } catch (...) {
+      // The buffer is simply freed.
+    }
+  }
+  ::operator delete(header);
+}
+
+}
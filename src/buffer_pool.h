@@ -0,0 +1,39 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "helpers.h"
+
+namespace hera {
+
+// A per-thread pool of byte buffers, so that the buffers needed by every execution
+// (return data, results, output) reuse earlier allocations instead of contending
+// on the allocator. Only a bounded number of reasonably sized buffers are kept.
+
+// Returns an empty buffer, possibly with capacity left from an earlier use.
+bytes acquireBuffer() noexcept;
+
+// Returns @buffer to the pool of the calling thread.
+void releaseBuffer(bytes&& buffer) noexcept;
+
+// Returns a raw buffer of at least @size bytes, e.g. for output handed out through the C API.
+uint8_t* acquireOutputBuffer(size_t size);
+
+// Returns a buffer obtained from acquireOutputBuffer() to the pool of the calling thread.
+void releaseOutputBuffer(uint8_t const* buffer) noexcept;
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <evmc/evmc.h>
+
+// Conversions between the big-endian values of EVMC and the little-endian memory of Wasm.
+
+namespace hera {
+
+namespace byte_order_detail {
+
+inline uint64_t load64(uint8_t const* src) noexcept
+{
+  uint64_t value;
+  std::memcpy(&value, src, sizeof(value));
+  return value;
+}
+
+inline void store64(uint8_t* dst, uint64_t value) noexcept
+{
+  std::memcpy(dst, &value, sizeof(value));
+}
+
+constexpr uint64_t fromBigEndian64(uint64_t value) noexcept
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(value);
+#else
+  return value;
+#endif
+}
+
+}
+
+/// Copies the @Size bytes at @src to @dst in reverse order. The ranges must not overlap.
+template <size_t Size>
+inline void reverseBytes(uint8_t const* src, uint8_t* dst) noexcept
+{
+  static_assert(Size == 16 || Size == 32, "Only 128 and 256 bit values are reversed.");
+#if defined(__AVX2__)
+  if constexpr (Size == 32) {
+    // Reverse the bytes of both lanes, then swap the lanes.
+    __m256i const reversed = _mm256_setr_epi8(
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+    );
+    __m256i value = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src));
+    value = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(value, reversed), 0x4e);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), value);
+    return;
+  }
+#endif
+#if defined(__SSSE3__)
+  __m128i const reversed = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  for (size_t i = 0; i < Size; i += 16) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + Size - 16 - i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(value, reversed));
+  }
+#else
+  for (size_t i = 0; i < Size; i += 8)
+    byte_order_detail::store64(dst + i, __builtin_bswap64(byte_order_detail::load64(src + Size - 8 - i)));
+#endif
+}
+
+/// Checks if the host supplied 256 bit @value exceeds UINT128_MAX.
+inline bool exceedsUint128(evmc_uint256be const& value) noexcept
+{
+  return (byte_order_detail::load64(value.bytes) | byte_order_detail::load64(value.bytes + 8)) != 0;
+}
+
+/// Returns the low 128 bits of the 256 bit @value.
+inline unsigned __int128 toUint128(evmc_uint256be const& value) noexcept
+{
+  using namespace byte_order_detail;
+  unsigned __int128 high = fromBigEndian64(load64(value.bytes + 16));
+  return (high << 64) | fromBigEndian64(load64(value.bytes + 24));
+}
+
+}
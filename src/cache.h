@@ -0,0 +1,246 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+namespace hera {
+
+// Caches are keyed by the Keccak-256 hash of the code (see keccak.h).
+using CodeHash = evmc::bytes32;
+
+// The key is already a cryptographic hash, its leading bytes are good enough.
+struct CodeHashHasher {
+  size_t operator()(CodeHash const& hash) const noexcept
+  {
+    size_t ret;
+    std::memcpy(&ret, hash.bytes, sizeof(ret));
+    return ret;
+  }
+};
+
+/// A bounded least-recently-used cache, safe to use from multiple threads.
+///
+/// Values are handed out as shared pointers, so an entry evicted while
+/// still in use stays alive until its last user releases it.
+/// A capacity of zero disables the cache.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  explicit LruCache(size_t capacity = 0) noexcept: m_capacity(capacity) {}
+
+  LruCache(LruCache const&) = delete;
+  LruCache& operator=(LruCache const&) = delete;
+
+  /// Returns the entry for @key (and marks it as the most recently used) or nullptr.
+  std::shared_ptr<Value> find(Key const& key)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+      ++m_misses;
+      return {};
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second;
+  }
+
+  /// Inserts or replaces the entry for @key, evicting the least recently used entries if needed.
+  void insert(Key const& key, std::shared_ptr<Value> value)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_capacity == 0)
+      return;
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      it->second->second = std::move(value);
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return;
+    }
+    m_entries.emplace_front(key, std::move(value));
+    m_index.emplace(key, m_entries.begin());
+    trim();
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_index.clear();
+    m_entries.clear();
+  }
+
+  void setCapacity(size_t capacity)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_capacity = capacity;
+    trim();
+  }
+
+  size_t capacity() const
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_capacity;
+  }
+
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_entries.size();
+  }
+
+  uint64_t hits() const
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_hits;
+  }
+
+  uint64_t misses() const
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_misses;
+  }
+
+private:
+  using Entries = std::list<std::pair<Key, std::shared_ptr<Value>>>;
+
+  // The caller must hold the lock.
+  void trim()
+  {
+    while (m_entries.size() > m_capacity) {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  size_t m_capacity = 0;
+  Entries m_entries;
+  std::unordered_map<Key, typename Entries::iterator, Hash> m_index;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+};
+
+/// An LruCache split into independently locked shards, so that threads looking up
+/// different keys rarely contend. Keys are assigned to shards by their hash and the
+/// capacity is divided evenly, so the least recently used order is kept per shard.
+/// A capacity below the number of shards is kept by as many shards, of one entry each.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, size_t Shards = 8>
+class ShardedLruCache {
+public:
+  explicit ShardedLruCache(size_t capacity = 0) { setCapacity(capacity); }
+
+  std::shared_ptr<Value> find(Key const& key) { return shard(key).find(key); }
+
+  void insert(Key const& key, std::shared_ptr<Value> value) { shard(key).insert(key, std::move(value)); }
+
+  void clear()
+  {
+    for (auto& s: m_shards)
+      s.clear();
+  }
+
+  /// Keeps exactly @capacity entries in total. Entries of shards which are no longer
+  /// used are dropped, the others may not be found again until they are evicted.
+  void setCapacity(size_t capacity)
+  {
+    size_t used = std::max<size_t>(1, std::min(capacity, Shards));
+    for (size_t i = 0; i < Shards; ++i)
+      m_shards[i].setCapacity(i < used ? capacity / used + (i < capacity % used) : 0);
+    m_usedShards.store(used, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return sum(&Shard::capacity); }
+  size_t size() const { return sum(&Shard::size); }
+  uint64_t hits() const { return sum(&Shard::hits); }
+  uint64_t misses() const { return sum(&Shard::misses); }
+
+private:
+  using Shard = LruCache<Key, Value, Hash>;
+
+  // Skips the low bits of the hash, which the hash table of the shard uses.
+  Shard& shard(Key const& key) { return m_shards[(Hash{}(key) >> 7) % m_usedShards.load(std::memory_order_relaxed)]; }
+
+  template <typename Result>
+  Result sum(Result (Shard::*getter)() const) const
+  {
+    Result ret = 0;
+    for (auto const& s: m_shards)
+      ret += (s.*getter)();
+    return ret;
+  }
+
+  std::array<Shard, Shards> m_shards;
+  std::atomic<size_t> m_usedShards{Shards};
+};
+
+/// Idle instances of one module, each handed to a single execution at a time.
+///
+/// An execution takes an instance (or creates one if none is idle, e.g. for a
+/// nested call to the same contract) and gives it back reset, so the next one
+/// skips instantiation. At most @capacity idle instances are kept.
+template <typename Instance>
+class InstancePool {
+public:
+  explicit InstancePool(size_t capacity) noexcept: m_capacity(capacity) {}
+
+  InstancePool(InstancePool const&) = delete;
+  InstancePool& operator=(InstancePool const&) = delete;
+
+  /// Returns an idle instance or nullptr.
+  std::shared_ptr<Instance> acquire()
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_idle.empty())
+      return {};
+    std::shared_ptr<Instance> ret = std::move(m_idle.back());
+    m_idle.pop_back();
+    return ret;
+  }
+
+  /// Takes back an instance, which must have been reset, unless the pool is full.
+  void release(std::shared_ptr<Instance> instance) noexcept
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_idle.size() < m_capacity) {
+      try {
+        m_idle.push_back(std::move(instance));
+      } catch (...) {
+        // The instance is dropped.
+      }
+    }
+  }
+
+private:
+  std::mutex m_mutex;
+  size_t const m_capacity;
+  std::vector<std::shared_ptr<Instance>> m_idle;
+};
+
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <mutex>
+
+#include "debugging.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace trace_detail {
+atomic<TraceLevel> traceLevel{maxTraceLevel};
+}
+
+namespace {
+
+mutex sinkMutex;
+ofstream sink;
+atomic<bool> sinkEnabled{false};
+
+}
+
+bool setTraceLevel(TraceLevel level) noexcept
+{
+  if (level > maxTraceLevel)
+    return false;
+  trace_detail::traceLevel.store(level, memory_order_relaxed);
+  return true;
+}
+
+bool openEvmTraceSink(string const& path) noexcept
+{
+  lock_guard<mutex> lock{sinkMutex};
+  sinkEnabled = false;
+  if (sink.is_open())
+    sink.close();
+  if (path.empty())
+    return true;
+
+  sink.open(path, ios::out | ios::binary | ios::trunc);
+  sinkEnabled = sink.is_open();
+  return sinkEnabled;
+}
+
+bool evmTraceSinkEnabled() noexcept
+{
+  return sinkEnabled.load(memory_order_relaxed);
+}
+
+void writeEvmTrace(EvmTraceRecord const& record, bytes_view stack) noexcept
+{
+  lock_guard<mutex> lock{sinkMutex};
+  if (!sink.is_open())
+    return;
+  sink.write(reinterpret_cast<char const*>(&record), sizeof(record));
+  sink.write(reinterpret_cast<char const*>(stack.data()), static_cast<streamsize>(stack.size()));
+}
+
+}
@@ -16,20 +16,95 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "helpers.h"
+
 namespace hera {
 
 #if HERA_DEBUGGING
+constexpr bool debugging = true;
+#else
+constexpr bool debugging = false;
+#endif
 
-#define HERA_DEBUG cerr
+/// The amount of tracing written to stderr.
+enum class TraceLevel : uint8_t {
+  none,
+  /// The execution as a whole: engines, caches, transformations and failures.
+  info,
+  /// Also every EEI method called.
+  eei,
+};
 
-#else
+/// Tracing is compiled out of builds without HERA_DEBUGGING.
+constexpr TraceLevel maxTraceLevel = debugging ? TraceLevel::eei : TraceLevel::none;
 
-struct NullStream {
-  template<typename T> NullStream& operator<<(const T&) { return *this; }
+namespace trace_detail {
+extern std::atomic<TraceLevel> traceLevel;
+}
+
+/// Sets the level traced from now on, up to maxTraceLevel (the default).
+bool setTraceLevel(TraceLevel level) noexcept;
+
+/// Whether messages of @level are traced. Constant false for levels compiled out.
+inline bool traceEnabled(TraceLevel level) noexcept
+{
+  if constexpr (maxTraceLevel == TraceLevel::none)
+    return false;
+  else
+    return level <= maxTraceLevel && level <= trace_detail::traceLevel.load(std::memory_order_relaxed);
+}
+
+namespace trace_detail {
+// Lets both branches of HERA_TRACE be void, binding weaker than the streaming operators.
+struct Voidify {
+  void operator&(std::ostream&) noexcept {}
 };
+}
 
-#define HERA_DEBUG true ? NullStream{} : NullStream{}
+/// Streams a message of the given TraceLevel to stderr. The operands are only evaluated
+/// if the level is traced, and not compiled in at all without HERA_DEBUGGING.
+#define HERA_TRACE(level) \
+  !::hera::traceEnabled(::hera::TraceLevel::level) ? (void)0 : ::hera::trace_detail::Voidify{} & std::cerr
 
-#endif
+#define HERA_DEBUG HERA_TRACE(info)
+
+/// Prints the call depth as "[depth]", without building a string.
+struct TraceDepth {
+  int32_t depth;
+};
+
+inline std::ostream& operator<<(std::ostream& out, TraceDepth depth)
+{
+  return out << '[' << depth.depth << ']';
+}
+
+/// One record of the binary EVM trace (see openEvmTraceSink), in host byte order.
+/// It is followed by @stackSize items of 32 bytes each, in big-endian order, bottom first.
+struct EvmTraceRecord {
+  int64_t gasLeft;
+  int32_t depth;
+  uint32_t pc;
+  uint32_t gasCost;
+  uint16_t stackSize;
+  uint8_t opcode;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(EvmTraceRecord) == 24, "EvmTraceRecord must not be padded.");
+
+/// Makes debugEvmTrace write binary records to @path (truncated) instead of
+/// JSON lines to stdout. An empty path goes back to JSON.
+bool openEvmTraceSink(std::string const& path) noexcept;
+
+/// Whether a binary trace sink is open.
+bool evmTraceSinkEnabled() noexcept;
+
+/// Appends @record and its stack (of record.stackSize items) to the binary trace sink.
+void writeEvmTrace(EvmTraceRecord const& record, bytes_view stack) noexcept;
 
 }
@@ -14,14 +14,18 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 
+#include "byte_order.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "metrics.h"
+#include "nested_call.h"
 
 #include <evmc/instructions.h>
 
@@ -30,45 +34,26 @@ using namespace std;
 namespace hera {
 namespace
 {
-/* Checks if host supplied 256 bit value exceeds UINT128_MAX */
-bool exceedsUint128(evmc_uint256be const& value) noexcept
+char const* callKindName(EthereumInterface::EEICallKind kind) noexcept
 {
-    for (unsigned i = 0; i < 16; i++)
+    switch (kind)
     {
-        if (value.bytes[i])
-            return true;
+    case EthereumInterface::EEICallKind::Call: return "call";
+    case EthereumInterface::EEICallKind::CallCode: return "callCode";
+    case EthereumInterface::EEICallKind::CallDelegate: return "callDelegate";
+    case EthereumInterface::EEICallKind::CallStatic: return "callStatic";
     }
-    return false;
+    return "unknown";
 }
 }  // namespace
 
-bool WasmEngine::benchmarkingEnabled = false;
-
-void WasmEngine::collectBenchmarkingData()
-{
-  // Convert duration to string with microsecond units.
-  constexpr auto to_us_str = [](clock::duration d) {
-    return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
-  };
-
-  const auto now = clock::now();
-  const auto instantiationDuration = executionStartTime - instantiationStartTime;
-  const auto executionDuration = now - executionStartTime;
-
-  const auto log = "Time [us]: " + to_us_str(instantiationDuration + executionDuration) +
-                   " (instantiation: " + to_us_str(instantiationDuration) +
-                   ", execution: " + to_us_str(executionDuration) + ")\n";
-  std::cerr << log;
-  std::ofstream{"hera_benchmarks.log", std::ios::out | std::ios::app} << log;
-}
-
 #if HERA_DEBUGGING
   void EthereumInterface::debugPrintMem(bool useHex, uint32_t offset, uint32_t length)
   {
       heraAssert((offset + length) > offset, "Overflow.");
       heraAssert(memorySize() >= (offset + length), "Out of memory bounds.");
 
-      cerr << depthToString() << " DEBUG printMem" << (useHex ? "Hex(" : "(") << hex << "0x" << offset << ":0x" << length << "): " << dec;
+      cerr << traceDepth() << " DEBUG printMem" << (useHex ? "Hex(" : "(") << hex << "0x" << offset << ":0x" << length << "): " << dec;
       if (useHex)
       {
         cerr << hex;
@@ -90,13 +75,13 @@ void WasmEngine::collectBenchmarkingData()
   {
       evmc_uint256be path = loadBytes32(pathOffset);
 
-      HERA_DEBUG << depthToString() << " DEBUG printStorage" << (useHex ? "Hex" : "") << "(0x" << hex;
+      cerr << traceDepth() << " DEBUG printStorage" << (useHex ? "Hex" : "") << "(0x" << hex;
 
       // Print out the path
       for (uint8_t b: path.bytes)
         cerr << static_cast<int>(b);
 
-      HERA_DEBUG << "): " << dec;
+      cerr << "): " << dec;
 
       evmc_bytes32 result = m_host.get_storage(m_msg.destination, path);
 
@@ -117,12 +102,31 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::debugEvmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp)
   {
-      HERA_DEBUG << depthToString() << " evmTrace\n";
+      HERA_TRACE(eei) << traceDepth() << " evmTrace\n";
 
       static constexpr int stackItemSize = sizeof(evmc_uint256be);
       heraAssert(sp <= (1024 * stackItemSize), "EVM stack pointer out of bounds.");
       heraAssert(opcode >= 0x00 && opcode <= 0xff, "Invalid EVM instruction.");
 
+      if (evmTraceSinkEnabled()) {
+        EvmTraceRecord record{};
+        record.gasLeft = m_result.gasLeft;
+        record.depth = m_msg.depth;
+        record.pc = pc;
+        record.gasCost = cost;
+        record.stackSize = static_cast<uint16_t>(sp >= 0 ? sp / stackItemSize + 1 : 0);
+        record.opcode = static_cast<uint8_t>(opcode);
+
+        thread_local bytes stack;
+        stack.clear();
+        for (int32_t i = 0; i <= sp; i += stackItemSize) {
+          evmc_uint256be x = loadUint256(static_cast<uint32_t>(i));
+          stack.append(x.bytes, sizeof(x.bytes));
+        }
+        writeEvmTrace(record, stack);
+        return;
+      }
+
       const char* const* const opNamesTable = evmc_get_instruction_names_table(EVMC_BYZANTIUM);
       const char* opName = opNamesTable[static_cast<uint8_t>(opcode)];
       if (opName == nullptr)
@@ -141,13 +145,16 @@ void WasmEngine::collectBenchmarkingData()
         if (i != sp)
           cout << ',';
       }
-      cout << "]}" << endl;
+      // Not flushing every line, that is what makes tracing slow.
+      cout << "]}\n";
   }
 #endif
 
   void EthereumInterface::eeiUseGas(int64_t gas)
   {
-      HERA_DEBUG << depthToString() << " useGas " << gas << "\n";
+      HostFunctionTimer metric{HostFunction::useGas, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " useGas " << gas << "\n";
 
       ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
 
@@ -156,7 +163,9 @@ void WasmEngine::collectBenchmarkingData()
 
   int64_t EthereumInterface::eeiGetGasLeft()
   {
-      HERA_DEBUG << depthToString() << " getGasLeft\n";
+      HostFunctionTimer metric{HostFunction::getGasLeft, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getGasLeft\n";
 
       static_assert(is_same<decltype(m_result.gasLeft), int64_t>::value, "int64_t type expected");
 
@@ -167,7 +176,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetAddress(uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getAddress " << hex << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getAddress, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getAddress " << hex << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -176,7 +187,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetExternalBalance(uint32_t addressOffset, uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getExternalBalance " << hex << addressOffset << " " << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getExternalBalance, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getExternalBalance " << hex << addressOffset << " " << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::balance);
 
@@ -187,7 +200,9 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiGetBlockHash(uint64_t number, uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getBlockHash " << hex << number << " " << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getBlockHash, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockHash " << hex << number << " " << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::blockhash);
 
@@ -203,7 +218,9 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiGetCallDataSize()
   {
-      HERA_DEBUG << depthToString() << " getCallDataSize\n";
+      HostFunctionTimer metric{HostFunction::getCallDataSize, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getCallDataSize\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -212,7 +229,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiCallDataCopy(uint32_t resultOffset, uint32_t dataOffset, uint32_t length)
   {
-      HERA_DEBUG << depthToString() << " callDataCopy " << hex << resultOffset << " " << dataOffset << " " << length << dec << "\n";
+      HostFunctionTimer metric{HostFunction::callDataCopy, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " callDataCopy " << hex << resultOffset << " " << dataOffset << " " << length << dec << "\n";
 
       safeChargeDataCopy(length, GasSchedule::verylow);
 
@@ -221,7 +240,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetCaller(uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getCaller " << hex << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getCaller, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getCaller " << hex << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -230,7 +251,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetCallValue(uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getCallValue " << hex << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getCallValue, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getCallValue " << hex << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -239,7 +262,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiCodeCopy(uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
   {
-      HERA_DEBUG << depthToString() << " codeCopy " << hex << resultOffset << " " << codeOffset << " " << length << dec << "\n";
+      HostFunctionTimer metric{HostFunction::codeCopy, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " codeCopy " << hex << resultOffset << " " << codeOffset << " " << length << dec << "\n";
 
       safeChargeDataCopy(length, GasSchedule::verylow);
 
@@ -248,7 +273,9 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiGetCodeSize()
   {
-      HERA_DEBUG << depthToString() << " getCodeSize\n";
+      HostFunctionTimer metric{HostFunction::getCodeSize, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getCodeSize\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -257,22 +284,27 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiExternalCodeCopy(uint32_t addressOffset, uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
   {
-      HERA_DEBUG << depthToString() << " externalCodeCopy " << hex << addressOffset << " " << resultOffset << " " << codeOffset << " " << length << dec << "\n";
+      HostFunctionTimer metric{HostFunction::externalCodeCopy, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " externalCodeCopy " << hex << addressOffset << " " << resultOffset << " " << codeOffset << " " << length << dec << "\n";
 
       safeChargeDataCopy(length, GasSchedule::extcode);
 
       evmc_address address = loadAddress(addressOffset);
-      // TODO: optimise this so no copy needs to be created
-      bytes codeBuffer(length, '\0');
-      size_t numCopied = m_host.copy_code(address, codeOffset, codeBuffer.data(), codeBuffer.size());
-      ensureCondition(numCopied == length, InvalidMemoryAccess, "Out of bounds (source) memory copy");
+      ensureCondition((resultOffset + length) >= resultOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+      ensureCondition(memorySize() >= (resultOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
 
-      storeMemory(codeBuffer, 0, resultOffset, length);
+      // The host copies straight into the wasm memory.
+      uint8_t* result = length ? memoryPointer(resultOffset, length) : nullptr;
+      size_t numCopied = m_host.copy_code(address, codeOffset, result, length);
+      ensureCondition(numCopied == length, InvalidMemoryAccess, "Out of bounds (source) memory copy");
   }
 
   uint32_t EthereumInterface::eeiGetExternalCodeSize(uint32_t addressOffset)
   {
-      HERA_DEBUG << depthToString() << " getExternalCodeSize " << hex << addressOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getExternalCodeSize, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getExternalCodeSize " << hex << addressOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::extcode);
 
@@ -284,7 +316,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetBlockCoinbase(uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getBlockCoinbase " << hex << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getBlockCoinbase, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockCoinbase " << hex << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -293,7 +327,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetBlockDifficulty(uint32_t offset)
   {
-      HERA_DEBUG << depthToString() << " getBlockDifficulty " << hex << offset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getBlockDifficulty, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockDifficulty " << hex << offset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -302,7 +338,9 @@ void WasmEngine::collectBenchmarkingData()
 
   int64_t EthereumInterface::eeiGetBlockGasLimit()
   {
-      HERA_DEBUG << depthToString() << " getBlockGasLimit\n";
+      HostFunctionTimer metric{HostFunction::getBlockGasLimit, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockGasLimit\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -313,7 +351,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetTxGasPrice(uint32_t valueOffset)
   {
-      HERA_DEBUG << depthToString() << " getTxGasPrice " << hex << valueOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getTxGasPrice, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getTxGasPrice " << hex << valueOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -322,7 +362,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiLog(uint32_t dataOffset, uint32_t length, uint32_t numberOfTopics, uint32_t topic1, uint32_t topic2, uint32_t topic3, uint32_t topic4)
   {
-      HERA_DEBUG << depthToString() << " log " << hex << dataOffset << " " << length << " " << numberOfTopics << dec << "\n";
+      HostFunctionTimer metric{HostFunction::log, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " log " << hex << dataOffset << " " << length << " " << numberOfTopics << dec << "\n";
 
       static_assert(GasSchedule::log <= 65536, "Gas cost of log could lead to overflow");
       static_assert(GasSchedule::logTopic <= 65536, "Gas cost of logTopic could lead to overflow");
@@ -342,15 +384,16 @@ void WasmEngine::collectBenchmarkingData()
       topics[3] = (numberOfTopics == 4) ? loadBytes32(topic4) : evmc::uint256be{};
 
       ensureSourceMemoryBounds(dataOffset, length);
-      bytes data(length, '\0');
-      loadMemory(dataOffset, data, length);
+      uint8_t const* data = length ? memoryPointer(dataOffset, length) : nullptr;
 
-      m_host.emit_log(m_msg.destination, data.data(), length, topics.data(), numberOfTopics);
+      m_host.emit_log(m_msg.destination, data, length, topics.data(), numberOfTopics);
   }
 
   int64_t EthereumInterface::eeiGetBlockNumber()
   {
-      HERA_DEBUG << depthToString() << " getBlockNumber\n";
+      HostFunctionTimer metric{HostFunction::getBlockNumber, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockNumber\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -361,7 +404,9 @@ void WasmEngine::collectBenchmarkingData()
 
   int64_t EthereumInterface::eeiGetBlockTimestamp()
   {
-      HERA_DEBUG << depthToString() << " getBlockTimestamp\n";
+      HostFunctionTimer metric{HostFunction::getBlockTimestamp, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getBlockTimestamp\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -372,7 +417,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiGetTxOrigin(uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " getTxOrigin " << hex << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::getTxOrigin, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getTxOrigin " << hex << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -381,7 +428,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiStorageStore(uint32_t pathOffset, uint32_t valueOffset)
   {
-      HERA_DEBUG << depthToString() << " storageStore " << hex << pathOffset << " " << valueOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::storageStore, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " storageStore " << hex << pathOffset << " " << valueOffset << dec << "\n";
 
       static_assert(
         GasSchedule::storageStoreCreate >= GasSchedule::storageStoreChange,
@@ -395,7 +444,7 @@ void WasmEngine::collectBenchmarkingData()
 
       const auto path = loadBytes32(pathOffset);
       const auto value = loadBytes32(valueOffset);
-      const auto current = m_host.get_storage(m_msg.destination, path);
+      const auto current = getStorage(path);
 
       // Charge the right amount in case of the create case.
       if (is_zero(current) && !is_zero(value))
@@ -403,27 +452,31 @@ void WasmEngine::collectBenchmarkingData()
 
       // We do not need to take care about the delete case (gas refund), the client does it.
 
-      m_host.set_storage(m_msg.destination, path, value);
+      setStorage(path, value);
   }
 
   void EthereumInterface::eeiStorageLoad(uint32_t pathOffset, uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " storageLoad " << hex << pathOffset << " " << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::storageLoad, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " storageLoad " << hex << pathOffset << " " << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::storageLoad);
 
       evmc_bytes32 path = loadBytes32(pathOffset);
-      evmc_bytes32 result = m_host.get_storage(m_msg.destination, path);
+      evmc_bytes32 result = getStorage(path);
 
       storeBytes32(result, resultOffset);
   }
 
   void EthereumInterface::eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size)
   {
-      HERA_DEBUG << depthToString() << " " << (revert ? "revert " : "finish ") << hex << offset << " " << size << dec << "\n";
+      HostFunctionTimer metric{revert ? HostFunction::revert : HostFunction::finish, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " " << (revert ? "revert " : "finish ") << hex << offset << " " << size << dec << "\n";
 
       ensureSourceMemoryBounds(offset, size);
-      m_result.returnValue = bytes(size, '\0');
+      m_result.returnValue.assign(size, '\0');
       loadMemory(offset, m_result.returnValue, size);
 
       m_result.isRevert = revert;
@@ -433,7 +486,9 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiGetReturnDataSize()
   {
-      HERA_DEBUG << depthToString() << " getReturnDataSize\n";
+      HostFunctionTimer metric{HostFunction::getReturnDataSize, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " getReturnDataSize\n";
 
       takeInterfaceGas(GasSchedule::base);
 
@@ -442,7 +497,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiReturnDataCopy(uint32_t dataOffset, uint32_t offset, uint32_t size)
   {
-      HERA_DEBUG << depthToString() << " returnDataCopy " << hex << dataOffset << " " << offset << " " << size << dec << "\n";
+      HostFunctionTimer metric{HostFunction::returnDataCopy, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " returnDataCopy " << hex << dataOffset << " " << offset << " " << size << dec << "\n";
 
       safeChargeDataCopy(size, GasSchedule::verylow);
 
@@ -451,6 +508,13 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength)
   {
+      HostFunctionTimer metric{
+        kind == EEICallKind::Call ? HostFunction::call :
+        kind == EEICallKind::CallCode ? HostFunction::callCode :
+        kind == EEICallKind::CallDelegate ? HostFunction::callDelegate : HostFunction::callStatic,
+        m_result.gasLeft
+      };
+
       ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
 
       evmc_message call_message;
@@ -482,32 +546,21 @@ void WasmEngine::collectBenchmarkingData()
         break;
       }
 
-#if HERA_DEBUGGING
-      string methodName;
-      switch (kind) {
-      case EEICallKind::Call: methodName = "call"; break;
-      case EEICallKind::CallCode: methodName = "callCode"; break;
-      case EEICallKind::CallDelegate: methodName = "callDelegate"; break;
-      case EEICallKind::CallStatic: methodName = "callStatic"; break;
-      }
-
-      HERA_DEBUG <<
-        depthToString() << " " <<
-        methodName << " " << hex <<
+      HERA_TRACE(eei) <<
+        traceDepth() << " " <<
+        callKindName(kind) << " " << hex <<
         gas << " " <<
         addressOffset << " " <<
         valueOffset << " " <<
         dataOffset << " " <<
         dataLength << dec << "\n";
-#endif
 
-      // NOTE: this must be declared outside the condition to ensure the memory doesn't go out of scope
-      bytes input_data;
+      // NOTE: the input is passed as a view of the wasm memory. This instance is suspended
+      // until the host returns, and the callee runs in its own instance, so the memory
+      // cannot grow (and move) while the view is in use.
       if (dataLength) {
         ensureSourceMemoryBounds(dataOffset, dataLength);
-        input_data.resize(dataLength);
-        loadMemory(dataOffset, input_data, dataLength);
-        call_message.input_data = input_data.data();
+        call_message.input_data = memoryPointer(dataOffset, dataLength);
         call_message.input_size = dataLength;
       } else {
         call_message.input_data = nullptr;
@@ -545,7 +598,14 @@ void WasmEngine::collectBenchmarkingData()
 
       call_message.gas = gas;
 
+      // Only asking the host for the code hash if a nested execution can make use of it.
+      if (call_message.kind == EVMC_CALL && nestedCallRecordingEnabled())
+        recordNestedCall(call_message, m_host.get_code_hash(call_message.destination));
       auto call_result = m_host.call(call_message);
+      clearNestedCall();
+      // A static call cannot change any storage.
+      if (kind != EEICallKind::CallStatic)
+        m_storageCache.clear();
 
       if (call_result.output_data) {
         m_lastReturnData.assign(call_result.output_data, call_result.output_data + call_result.output_size);
@@ -569,7 +629,9 @@ void WasmEngine::collectBenchmarkingData()
 
   uint32_t EthereumInterface::eeiCreate(uint32_t valueOffset, uint32_t dataOffset, uint32_t length, uint32_t resultOffset)
   {
-      HERA_DEBUG << depthToString() << " create " << hex << valueOffset << " " << dataOffset << " " << length << dec << " " << resultOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::create, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " create " << hex << valueOffset << " " << dataOffset << " " << length << dec << " " << resultOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::create);
 
@@ -586,13 +648,10 @@ void WasmEngine::collectBenchmarkingData()
       if (!enoughSenderBalanceFor(create_message.value))
         return 1;
 
-      // NOTE: this must be declared outside the condition to ensure the memory doesn't go out of scope
-      bytes contract_code;
+      // NOTE: the code is passed as a view of the wasm memory (see eeiCall).
       if (length) {
         ensureSourceMemoryBounds(dataOffset, length);
-        contract_code.resize(length);
-        loadMemory(dataOffset, contract_code, length);
-        create_message.input_data = contract_code.data();
+        create_message.input_data = memoryPointer(dataOffset, length);
         create_message.input_size = length;
       } else {
         create_message.input_data = nullptr;
@@ -608,6 +667,7 @@ void WasmEngine::collectBenchmarkingData()
       takeInterfaceGas(gas);
 
       auto create_result = m_host.call(create_message);
+      m_storageCache.clear();
 
       /* Return unspent gas */
       heraAssert(create_result.gas_left >= 0, "EVMC returned negative gas left");
@@ -634,7 +694,9 @@ void WasmEngine::collectBenchmarkingData()
 
   void EthereumInterface::eeiSelfDestruct(uint32_t addressOffset)
   {
-      HERA_DEBUG << depthToString() << " selfDestruct " << hex << addressOffset << dec << "\n";
+      HostFunctionTimer metric{HostFunction::selfDestruct, m_result.gasLeft};
+
+      HERA_TRACE(eei) << traceDepth() << " selfDestruct " << hex << addressOffset << dec << "\n";
 
       takeInterfaceGas(GasSchedule::selfdestruct);
 
@@ -650,6 +712,26 @@ void WasmEngine::collectBenchmarkingData()
       throw EndExecution{};
   }
 
+  evmc::bytes32 EthereumInterface::getStorage(evmc::bytes32 const& path)
+  {
+    if (!m_cacheStorage)
+      return m_host.get_storage(m_msg.destination, path);
+
+    auto it = m_storageCache.find(path);
+    if (it != m_storageCache.end())
+      return it->second;
+    evmc::bytes32 value = m_host.get_storage(m_msg.destination, path);
+    m_storageCache.emplace(path, value);
+    return value;
+  }
+
+  void EthereumInterface::setStorage(evmc::bytes32 const& path, evmc::bytes32 const& value)
+  {
+    m_host.set_storage(m_msg.destination, path, value);
+    if (m_cacheStorage)
+      m_storageCache[path] = value;
+  }
+
   void EthereumInterface::takeGas(int64_t gas)
   {
     // NOTE: gas >= 0 is validated by the callers of this method
@@ -667,6 +749,8 @@ void WasmEngine::collectBenchmarkingData()
 
   /*
    * Memory Operations
+   *
+   * These check the bounds once and then copy the whole range through memoryPointer().
    */
 
   void EthereumInterface::ensureSourceMemoryBounds(uint32_t offset, uint32_t length) {
@@ -674,18 +758,13 @@ void WasmEngine::collectBenchmarkingData()
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
   }
 
-  void EthereumInterface::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length)
+  template <size_t Length>
+  void EthereumInterface::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst)
   {
-    // NOTE: the source bound check is not needed as the caller already ensures it
-    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
-    ensureCondition(memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
-
-    if (!length)
-      HERA_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset << dec << "\n";
+    ensureCondition((srcOffset + Length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(memorySize() >= (srcOffset + Length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
 
-    for (uint32_t i = 0; i < length; ++i) {
-      dst[length - (i + 1)] = memoryGet(srcOffset + i);
-    }
+    reverseBytes<Length>(memoryPointer(srcOffset, Length), dst);
   }
 
   void EthereumInterface::loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length)
@@ -695,11 +774,10 @@ void WasmEngine::collectBenchmarkingData()
     ensureCondition(memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
 
     if (!length)
-      HERA_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset << dec << "\n";
+      HERA_TRACE(eei) << "Zero-length memory load from offset 0x" << hex << srcOffset << dec << "\n";
 
-    for (uint32_t i = 0; i < length; ++i) {
-      dst[i] = memoryGet(srcOffset + i);
-    }
+    if (length)
+      memcpy(&dst[0], memoryPointer(srcOffset, length), length);
   }
 
   void EthereumInterface::loadMemory(uint32_t srcOffset, bytes& dst, size_t length)
@@ -710,24 +788,19 @@ void WasmEngine::collectBenchmarkingData()
     ensureCondition(dst.size() >= length, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
 
     if (!length)
-      HERA_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset << dec <<"\n";
+      HERA_TRACE(eei) << "Zero-length memory load from offset 0x" << hex << srcOffset << dec <<"\n";
 
-    for (uint32_t i = 0; i < length; ++i) {
-      dst[i] = memoryGet(srcOffset + i);
-    }
+    if (length)
+      memcpy(&dst[0], memoryPointer(srcOffset, length), length);
   }
 
-  void EthereumInterface::storeMemoryReverse(const uint8_t *src, uint32_t dstOffset, uint32_t length)
+  template <size_t Length>
+  void EthereumInterface::storeMemoryReverse(const uint8_t *src, uint32_t dstOffset)
   {
-    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
-    ensureCondition(memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
-
-    if (!length)
-      HERA_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset << dec << "\n";
+    ensureCondition((dstOffset + Length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(memorySize() >= (dstOffset + Length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
 
-    for (uint32_t i = 0; i < length; ++i) {
-      memorySet(dstOffset + length - (i + 1), src[i]);
-    }
+    reverseBytes<Length>(src, memoryPointer(dstOffset, Length));
   }
 
   void EthereumInterface::storeMemory(const uint8_t *src, uint32_t dstOffset, uint32_t length)
@@ -736,11 +809,10 @@ void WasmEngine::collectBenchmarkingData()
     ensureCondition(memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
 
     if (!length)
-      HERA_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset << dec << "\n";
+      HERA_TRACE(eei) << "Zero-length memory store to offset 0x" << hex << dstOffset << dec << "\n";
 
-    for (uint32_t i = 0; i < length; ++i) {
-      memorySet(dstOffset + i, src[i]);
-    }
+    if (length)
+      memcpy(memoryPointer(dstOffset, length), src, length);
   }
 
   void EthereumInterface::storeMemory(bytes_view src, uint32_t srcOffset, uint32_t dstOffset, uint32_t length)
@@ -751,11 +823,10 @@ void WasmEngine::collectBenchmarkingData()
     ensureCondition(memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
 
     if (!length)
-      HERA_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset << dec << "\n";
+      HERA_TRACE(eei) << "Zero-length memory store to offset 0x" << hex << dstOffset << dec << "\n";
 
-    for (uint32_t i = 0; i < length; i++) {
-      memorySet(dstOffset + i, src[srcOffset + i]);
-    }
+    if (length)
+      memcpy(memoryPointer(dstOffset, length), src.data() + srcOffset, length);
   }
 
   /*
@@ -777,13 +848,13 @@ void WasmEngine::collectBenchmarkingData()
   evmc::uint256be EthereumInterface::loadUint256(uint32_t srcOffset)
   {
     evmc::uint256be dst;
-    loadMemoryReverse(srcOffset, dst.bytes, 32);
+    loadMemoryReverse<32>(srcOffset, dst.bytes);
     return dst;
   }
 
   void EthereumInterface::storeUint256(evmc::uint256be const& src, uint32_t dstOffset)
   {
-    storeMemoryReverse(src.bytes, dstOffset, 32);
+    storeMemoryReverse<32>(src.bytes, dstOffset);
   }
 
   evmc::address EthereumInterface::loadAddress(uint32_t srcOffset)
@@ -801,14 +872,14 @@ void WasmEngine::collectBenchmarkingData()
   evmc::uint256be EthereumInterface::loadUint128(uint32_t srcOffset)
   {
     evmc::uint256be dst;
-    loadMemoryReverse(srcOffset, dst.bytes + 16, 16);
+    loadMemoryReverse<16>(srcOffset, dst.bytes + 16);
     return dst;
   }
 
   void EthereumInterface::storeUint128(evmc::uint256be const& src, uint32_t dstOffset)
   {
     ensureCondition(!exceedsUint128(src), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
-    storeMemoryReverse(src.bytes + 16, dstOffset, 16);
+    storeMemoryReverse<16>(src.bytes + 16, dstOffset);
   }
 
   /*
@@ -837,11 +908,6 @@ void WasmEngine::collectBenchmarkingData()
   unsigned __int128 EthereumInterface::safeLoadUint128(evmc_uint256be const& value)
   {
     ensureCondition(!exceedsUint128(value), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
-    unsigned __int128 ret = 0;
-    for (unsigned i = 16; i < 32; i++) {
-      ret <<= 8;
-      ret |= value.bytes[i];
-    }
-    return ret;
+    return toUint128(value);
   }
 }
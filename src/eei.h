@@ -19,12 +19,16 @@
 #include <chrono>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 
 #include <evmc/evmc.h>
 #include <evmc/evmc.hpp>
 
+#include "buffer_pool.h"
+#include "debugging.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "memory_budget.h"
 
 namespace hera {
 
@@ -32,16 +36,65 @@ struct ExecutionResult {
   int64_t gasLeft = 0;
   bytes returnValue;
   bool isRevert = false;
+  // Only measured if benchmarking is enabled.
+  std::chrono::nanoseconds instantiationTime{0};
+  std::chrono::nanoseconds executionTime{0};
+};
+
+/// Measures the instantiation and execution time of a single execution.
+/// Kept by the engine on the stack, so nested executions are measured separately.
+class BenchmarkTimer {
+public:
+  explicit BenchmarkTimer(bool enabled) noexcept: m_enabled(enabled)
+  {
+    if (m_enabled)
+      m_instantiationStart = clock::now();
+  }
+
+  void executionStarted() noexcept
+  {
+    if (m_enabled)
+      m_executionStart = clock::now();
+  }
+
+  void executionFinished(ExecutionResult& result) const noexcept
+  {
+    if (!m_enabled)
+      return;
+    result.instantiationTime = m_executionStart - m_instantiationStart;
+    result.executionTime = clock::now() - m_executionStart;
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+  bool m_enabled;
+  clock::time_point m_instantiationStart;
+  clock::time_point m_executionStart;
 };
 
 // There is a single engine instance in each VM instance and
-// likely execute() is called multiple times. As a result
+// likely execute() is called multiple times, also concurrently from
+// multiple threads and reentrantly for nested calls. As a result
 // an engine implementation cannot have instance variables with
-// side-effects.
+// side-effects. Caches keyed by the code hash are fine, as they
+// do not change the outcome of an execution, but must be thread-safe.
 class WasmEngine {
 public:
   virtual ~WasmEngine() noexcept = default;
 
+  /// Sets the number of compiled modules kept between executions.
+  /// Zero disables caching. Engines without a module cache ignore it.
+  virtual void setModuleCacheSize(size_t /*size*/) {}
+
+  /// Sets the number of idle instances kept per cached module, which are reset
+  /// and reused instead of instantiating the module again. Zero disables pooling.
+  /// Engines which instantiate for every execution ignore it.
+  virtual void setInstancePoolSize(size_t /*size*/) {}
+
+  /// Sets the directory compiled modules are persisted to (see ArtifactStore).
+  /// Engines without ahead-of-time compiled artifacts ignore it.
+  virtual void setArtifactDirectory(std::string const& /*directory*/) {}
+
   virtual ExecutionResult execute(
     evmc::HostContext& context,
     bytes_view code,
@@ -50,36 +103,38 @@ public:
     bool meterInterfaceGas
   ) = 0;
 
+  /// Checks deployed code. Engines with a module cache keep what they decoded,
+  /// so the first execution of the contract skips decoding and validating it again.
   virtual void verifyContract(bytes_view code) = 0;
 
-  static void enableBenchmarking() noexcept { benchmarkingEnabled = true; }
+  /// Compiles @code into the module cache ahead of its next execution, possibly on
+  /// another thread than the executions. Returns false if the engine does not keep
+  /// compiled modules (then nothing is done), and throws if the code is invalid.
+  virtual bool precompile(bytes_view /*code*/) { return false; }
 
-protected:
-  void instantiationStarted() noexcept
-  {
-    if (benchmarkingEnabled)
-      instantiationStartTime = clock::now();
-  }
+  /// Returns whether the module cache holds @code compiled, so executing it does not compile.
+  virtual bool isCompiled(bytes_view /*code*/) { return false; }
 
-  void executionStarted() noexcept
-  {
-    if (benchmarkingEnabled)
-      executionStartTime = clock::now();
-  }
+  /// Sets the number of executions after which code is compiled by the optimizing tier.
+  /// Only used by the tiered engine.
+  virtual void setTierUpThreshold(uint64_t /*threshold*/) {}
 
-  void executionFinished()
-  {
-    if (benchmarkingEnabled)
-      collectBenchmarkingData();
-  }
+  virtual void enableBenchmarking() noexcept { benchmarkingEnabled = true; }
 
-private:
-  void collectBenchmarkingData();
+  /// Makes executions keep the storage slots they access (see EthereumInterface).
+  virtual void enableStorageCache() noexcept { storageCacheEnabled = true; }
+
+  /// Bounds the memory of executions by @budget, which outlives the engine.
+  virtual void setMemoryBudget(MemoryBudget* budget) noexcept { memoryBudget = budget; }
 
-  using clock = std::chrono::high_resolution_clock;
-  static bool benchmarkingEnabled;
-  clock::time_point instantiationStartTime;
-  clock::time_point executionStartTime;
+protected:
+  BenchmarkTimer instantiationStarted() const noexcept { return BenchmarkTimer{benchmarkingEnabled}; }
+
+  bool storageCacheEnabled = false;
+  MemoryBudget* memoryBudget = nullptr;
+
+private:
+  bool benchmarkingEnabled = false;
 };
 
 class EthereumInterface {
@@ -89,29 +144,30 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult& _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _cacheStorage
   ):
     m_host{_host}, // FIXME: Change param to &.
     m_code{_code},
     m_msg(_msg),
+    m_lastReturnData(acquireBuffer()),
     m_result(_result),
-    m_meterGas(_meterGas)
+    m_meterGas(_meterGas),
+    m_cacheStorage(_cacheStorage)
   {
     heraAssert((m_msg.flags & ~uint32_t(EVMC_STATIC)) == 0, "Unknown flags not supported.");
 
     // set starting gas
     m_result.gasLeft = m_msg.gas;
     // set sane defaults
-    m_result.returnValue = {};
+    m_result.returnValue = acquireBuffer();
     m_result.isRevert = false;
   }
 
-// WAVM/WABT host functions access this interface through an instance,
-// which requires public methods.
-// TODO: update upstream WAVM/WABT to have a context (user data) passed down.
-#if HERA_WAVM == 0 && HERA_WABT == 0 && HERA_WASMER == 0
-protected:
-#endif
+  virtual ~EthereumInterface() noexcept { releaseBuffer(std::move(m_lastReturnData)); }
+
+// Host functions are bound from the EEI table (see eei_table.h) or access
+// this interface through an instance, which requires public methods.
   virtual size_t memorySize() const = 0 ;
   virtual void memorySet(size_t offset, uint8_t value) = 0;
   virtual uint8_t memoryGet(size_t offset) = 0;
@@ -167,18 +223,18 @@ private:
   void eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size);
 
   // Helpers methods
-  inline std::string depthToString() const {
-    return "[" + std::to_string(m_msg.depth) + "]";
-  }
+  TraceDepth traceDepth() const noexcept { return TraceDepth{m_msg.depth}; }
 
   void takeGas(int64_t gas);
   void takeInterfaceGas(int64_t gas);
 
   void ensureSourceMemoryBounds(uint32_t offset, uint32_t length);
-  void loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length);
+  template <size_t Length>
+  void loadMemoryReverse(uint32_t srcOffset, uint8_t *dst);
   void loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, bytes& dst, size_t length);
-  void storeMemoryReverse(const uint8_t *src, uint32_t dstOffset, uint32_t length);
+  template <size_t Length>
+  void storeMemoryReverse(const uint8_t *src, uint32_t dstOffset);
   void storeMemory(const uint8_t *src, uint32_t dstOffset, uint32_t length);
   void storeMemory(bytes_view src, uint32_t srcOffset, uint32_t dstOffset, uint32_t length);
 
@@ -198,6 +254,9 @@ private:
 
   bool enoughSenderBalanceFor(evmc_uint256be const& value);
 
+  evmc::bytes32 getStorage(evmc::bytes32 const& path);
+  void setStorage(evmc::bytes32 const& path, evmc::bytes32 const& value);
+
   static unsigned __int128 safeLoadUint128(evmc_uint256be const& value);
 
   evmc::HostContext& m_host;
@@ -206,6 +265,10 @@ private:
   bytes m_lastReturnData;
   ExecutionResult & m_result;
   bool m_meterGas = true;
+  // The slots of this frame read or written so far, written through to the host.
+  // Dropped after nested calls, which may change the storage by reentering the contract.
+  bool m_cacheStorage = false;
+  std::unordered_map<evmc::bytes32, evmc::bytes32> m_storageCache;
 };
 
 struct GasSchedule {
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "eei.h"
+
+namespace hera {
+
+// The call variants differ in their kind and whether they transfer value.
+template <EthereumInterface::EEICallKind Kind>
+uint32_t eeiCallWithValue(EthereumInterface& interface, int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength)
+{
+  return interface.eeiCall(Kind, gas, addressOffset, valueOffset, dataOffset, dataLength);
+}
+
+template <EthereumInterface::EEICallKind Kind>
+uint32_t eeiCallWithoutValue(EthereumInterface& interface, int64_t gas, uint32_t addressOffset, uint32_t dataOffset, uint32_t dataLength)
+{
+  return interface.eeiCall(Kind, gas, addressOffset, 0, dataOffset, dataLength);
+}
+
+// The host functions of the "ethereum" namespace as X(name, function) entries, where the
+// function is a method of EthereumInterface or takes the interface as its first parameter.
+// Engines which need a native function per host function instantiate their thunks from this
+// list, all others bind from the eeiFunctions table below.
+#define HERA_EEI_FUNCTIONS(X) \
+  X(useGas, &EthereumInterface::eeiUseGas) \
+  X(getGasLeft, &EthereumInterface::eeiGetGasLeft) \
+  X(getAddress, &EthereumInterface::eeiGetAddress) \
+  X(getExternalBalance, &EthereumInterface::eeiGetExternalBalance) \
+  X(getBlockHash, &EthereumInterface::eeiGetBlockHash) \
+  X(getCallDataSize, &EthereumInterface::eeiGetCallDataSize) \
+  X(callDataCopy, &EthereumInterface::eeiCallDataCopy) \
+  X(getCaller, &EthereumInterface::eeiGetCaller) \
+  X(getCallValue, &EthereumInterface::eeiGetCallValue) \
+  X(codeCopy, &EthereumInterface::eeiCodeCopy) \
+  X(getCodeSize, &EthereumInterface::eeiGetCodeSize) \
+  X(externalCodeCopy, &EthereumInterface::eeiExternalCodeCopy) \
+  X(getExternalCodeSize, &EthereumInterface::eeiGetExternalCodeSize) \
+  X(getBlockCoinbase, &EthereumInterface::eeiGetBlockCoinbase) \
+  X(getBlockDifficulty, &EthereumInterface::eeiGetBlockDifficulty) \
+  X(getBlockGasLimit, &EthereumInterface::eeiGetBlockGasLimit) \
+  X(getTxGasPrice, &EthereumInterface::eeiGetTxGasPrice) \
+  X(log, &EthereumInterface::eeiLog) \
+  X(getBlockNumber, &EthereumInterface::eeiGetBlockNumber) \
+  X(getBlockTimestamp, &EthereumInterface::eeiGetBlockTimestamp) \
+  X(getTxOrigin, &EthereumInterface::eeiGetTxOrigin) \
+  X(storageStore, &EthereumInterface::eeiStorageStore) \
+  X(storageLoad, &EthereumInterface::eeiStorageLoad) \
+  X(finish, &EthereumInterface::eeiFinish) \
+  X(revert, &EthereumInterface::eeiRevert) \
+  X(getReturnDataSize, &EthereumInterface::eeiGetReturnDataSize) \
+  X(returnDataCopy, &EthereumInterface::eeiReturnDataCopy) \
+  X(call, &eeiCallWithValue<EthereumInterface::EEICallKind::Call>) \
+  X(callCode, &eeiCallWithValue<EthereumInterface::EEICallKind::CallCode>) \
+  X(callDelegate, &eeiCallWithoutValue<EthereumInterface::EEICallKind::CallDelegate>) \
+  X(callStatic, &eeiCallWithoutValue<EthereumInterface::EEICallKind::CallStatic>) \
+  X(create, &EthereumInterface::eeiCreate) \
+  X(selfDestruct, &EthereumInterface::eeiSelfDestruct)
+
+// The most parameters a host function takes (log).
+constexpr size_t maxEEIParams = 7;
+
+enum class EEIValueType : uint8_t {
+  none,
+  i32,
+  i64
+};
+
+/// A host function with its Wasm signature. Arguments and results are passed as
+/// uint64_t, where i32 values are zero-extended, so that one thunk type fits all.
+struct EEIFunction {
+  char const* name;
+  EEIValueType result;
+  size_t paramCount;
+  EEIValueType params[maxEEIParams];
+  uint64_t (*call)(EthereumInterface& interface, uint64_t const* args);
+};
+
+namespace eei_table_detail {
+
+template <typename T>
+constexpr EEIValueType valueType() noexcept
+{
+  if constexpr (std::is_void_v<T>)
+    return EEIValueType::none;
+  else {
+    static_assert(std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8), "Unsupported EEI value type.");
+    return sizeof(T) == 8 ? EEIValueType::i64 : EEIValueType::i32;
+  }
+}
+
+template <auto Function, typename Result, typename... Params, size_t... Indices>
+uint64_t invoke(EthereumInterface& interface, uint64_t const* args, std::index_sequence<Indices...>)
+{
+  (void)args;
+  if constexpr (std::is_void_v<Result>) {
+    std::invoke(Function, interface, static_cast<Params>(args[Indices])...);
+    return 0;
+  } else {
+    return static_cast<std::make_unsigned_t<Result>>(std::invoke(Function, interface, static_cast<Params>(args[Indices])...));
+  }
+}
+
+template <auto Function, typename Result, typename... Params>
+uint64_t call(EthereumInterface& interface, uint64_t const* args)
+{
+  return invoke<Function, Result, Params...>(interface, args, std::index_sequence_for<Params...>{});
+}
+
+template <auto Function, typename Result, typename... Params>
+constexpr EEIFunction makeFunction(char const* name) noexcept
+{
+  static_assert(sizeof...(Params) <= maxEEIParams, "Too many EEI parameters.");
+  return EEIFunction{name, valueType<Result>(), sizeof...(Params), {valueType<Params>()...}, &call<Function, Result, Params...>};
+}
+
+template <auto Function, typename Result, typename... Params>
+constexpr EEIFunction makeFunction(char const* name, Result (EthereumInterface::*)(Params...)) noexcept
+{
+  return makeFunction<Function, Result, Params...>(name);
+}
+
+template <auto Function, typename Result, typename... Params>
+constexpr EEIFunction makeFunction(char const* name, Result (*)(EthereumInterface&, Params...)) noexcept
+{
+  return makeFunction<Function, Result, Params...>(name);
+}
+
+}
+
+/// Describes @Function, see HERA_EEI_FUNCTIONS.
+template <auto Function>
+constexpr EEIFunction makeEEIFunction(char const* name) noexcept
+{
+  return eei_table_detail::makeFunction<Function>(name, Function);
+}
+
+#define HERA_EEI_TABLE_ENTRY(name, function) makeEEIFunction<function>(#name),
+inline constexpr EEIFunction eeiFunctions[] = { HERA_EEI_FUNCTIONS(HERA_EEI_TABLE_ENTRY) };
+#undef HERA_EEI_TABLE_ENTRY
+
+/// Returns the host function called @name or nullptr. Meant for binding imports, not for calls.
+inline EEIFunction const* findEEIFunction(std::string_view name) noexcept
+{
+  for (EEIFunction const& function: eeiFunctions)
+    if (name == function.name)
+      return &function;
+  return nullptr;
+}
+
+}
@@ -50,6 +50,10 @@ class InvalidMemoryAccess : public HeraException {
 class EndExecution : public HeraException {
   using HeraException::HeraException;
 };
+/// The memory budget of the VM is used up by concurrent executions (see MemoryBudget).
+class MemoryBudgetExceeded : public HeraException {
+  using HeraException::HeraException;
+};
 
 /// Static Mode Violation.
 ///
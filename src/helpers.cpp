@@ -16,6 +16,7 @@
 
 #include <fstream>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 
 #include <evmc/evmc.h>
@@ -86,6 +87,25 @@ bytes parseHexString(const string& input) {
   return ret;
 }
 
+// Hand rolled decimal parser, for the same reasons as parseHexString().
+//
+// Returns false if input is empty, contains anything but digits or does not fit 64 bits.
+bool parseDecimalString(const string& input, uint64_t& output) {
+  if (input.empty())
+    return false;
+  uint64_t ret = 0;
+  for (char c : input) {
+    if (c < '0' || c > '9')
+      return false;
+    unsigned digit = unsigned(c - '0');
+    if (ret > (numeric_limits<uint64_t>::max() - digit) / 10)
+      return false;
+    ret = ret * 10 + digit;
+  }
+  output = ret;
+  return true;
+}
+
 bool hasWasmPreamble(bytes_view _input) {
   return
     _input.size() >= 8 &&
@@ -34,6 +34,8 @@ std::string bytesAsHexStr(bytes_view bytes);
 
 bytes parseHexString(std::string const& input);
 
+bool parseDecimalString(std::string const& input, uint64_t& output);
+
 bool hasWasmPreamble(bytes_view _input);
 
 bool hasWasmVersion(bytes_view _input, uint8_t _version);
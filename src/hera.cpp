@@ -18,17 +18,36 @@
 
 #include <limits>
 #include <cstring>
+#include <dirent.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <evmc/evmc.h>
 
+#include "benchmark_log.h"
+#include "buffer_pool.h"
+#include "cache.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "keccak.h"
+#include "memory_budget.h"
+#include "metering.h"
+#include "metrics.h"
+#include "module_scanner.h"
+#include "native_contracts.h"
+#include "nested_call.h"
 #if HERA_BINARYEN
 #include "binaryen.h"
 #endif
@@ -41,6 +60,10 @@
 #if HERA_WASMER
 #include "wasmer.h"
 #endif
+#if (HERA_BINARYEN || HERA_WABT) && (HERA_WAVM || HERA_WASMER)
+#define HERA_TIERED 1
+#include "tiered.h"
+#endif
 
 #include <hera/buildinfo.h>
 
@@ -63,6 +86,26 @@ const map<string, hera_evm1mode> evm1mode_options {
   { "runevm", hera_evm1mode::runevm_contract },
 };
 
+enum class hera_metering {
+  none,
+  // The sentinel contract meters code once, when it is deployed.
+  sentinel_contract,
+  // Hera instruments the code itself before every execution (see metering.h).
+  native,
+};
+
+const map<string, TraceLevel> trace_options {
+  { "none", TraceLevel::none },
+  { "info", TraceLevel::info },
+  { "eei", TraceLevel::eei },
+};
+
+const map<string, hera_metering> metering_options {
+  { "false", hera_metering::none },
+  { "true", hera_metering::sentinel_contract },
+  { "native", hera_metering::native },
+};
+
 using WasmEngineCreateFn = unique_ptr<WasmEngine>(*)();
 
 const map<string, WasmEngineCreateFn> wasm_engine_map {
@@ -76,11 +119,14 @@ const map<string, WasmEngineCreateFn> wasm_engine_map {
   { "wabt", WabtEngine::create },
 #endif
 #if HERA_WASMER
-  { "wabt", WasmerEngine::create },
+  { "wasmer", WasmerEngine::create },
+#endif
+#if HERA_TIERED
+  { "tiered", TieredEngine::create },
 #endif
 };
 
-WasmEngineCreateFn wasmEngineCreateFn =
+const WasmEngineCreateFn defaultWasmEngineCreateFn =
 // This is the order of preference.
 #if HERA_BINARYEN
     BinaryenEngine::create
@@ -95,13 +141,80 @@ WasmEngineCreateFn wasmEngineCreateFn =
 #endif
 ;
 
+// The number of compiled modules an engine keeps by default (see the "cache-size" option).
+constexpr size_t defaultModuleCacheSize = 64;
+
+// The number of idle instances kept per cached module by default (see the "instance-pool-size" option).
+constexpr size_t defaultInstancePoolSize = 4;
+
+// The number of executions after which the tiered engine compiles code by default (see the "tier-up-threshold" option).
+constexpr uint64_t defaultTierUpThreshold = 16;
+
+// Outputs of the sentinel and evm2wasm system contracts, keyed by the hash of their input.
+using TransformCache = ShardedLruCache<CodeHash, bytes, CodeHashHasher>;
+
+// The code to execute for some code in the state, after the checks and transformations of
+// hera_execute, keyed by the hash of the state code (see the "nested-call-fast-path" option).
+// The key may come from the client, so it is only used for the state code it was prepared for.
+struct PreparedCode {
+  bytes stateCode;
+  // Whether the code was replaced, otherwise the state code itself is executed.
+  bool transformed = false;
+  bytes code;
+  // The hash of the code executed, as computed by Hera.
+  CodeHash codeHash;
+  bool meterInterfaceGas = true;
+};
+
+using PreparedCodeCache = ShardedLruCache<CodeHash, PreparedCode, CodeHashHasher>;
+
+// Options are expected to be set before executing, but hera_execute itself
+// may be called concurrently from multiple threads.
 struct hera_instance : evmc_vm {
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
+  // Declared before the engine, which refers to it.
+  MemoryBudget memoryBudget;
+  WasmEngineCreateFn engineCreateFn = defaultWasmEngineCreateFn;
+  unique_ptr<WasmEngine> engine = engineCreateFn();
   hera_evm1mode evm1mode = hera_evm1mode::reject;
-  bool metering = false;
+  hera_metering metering = hera_metering::none;
+  bool benchmarking = false;
+  bool storageCache = false;
+  bool nestedCallFastPath = false;
+  size_t moduleCacheSize = defaultModuleCacheSize;
+  size_t instancePoolSize = defaultInstancePoolSize;
+  uint64_t tierUpThreshold = defaultTierUpThreshold;
+  string artifactDirectory;
   map<evmc::address, bytes> contract_preload_list;
+  map<evmc::address, NativeContract const*> native_contracts;
+  TransformCache sentinelCache{defaultModuleCacheSize};
+  TransformCache evm2wasmCache{defaultModuleCacheSize};
+  TransformCache nativeMeteringCache{defaultModuleCacheSize};
+  // Cleared when the memory limit changes.
+  TransformCache memoryLimitCache{defaultModuleCacheSize};
+  PreparedCodeCache preparedCodeCache{defaultModuleCacheSize};
+  // The interpreter produced by the runevm contract, generated on first use.
+  // Recursive in case generating it leads to a nested execution on the same thread.
+  bytes runevmInterpreter;
+  recursive_mutex runevmMutex;
+
+  hera_instance() noexcept : evmc_vm({EVMC_ABI_VERSION, "hera", hera_get_buildinfo()->project_version, nullptr, nullptr, nullptr, nullptr})
+  {
+    configureEngine();
+  }
 
-  hera_instance() noexcept : evmc_vm({EVMC_ABI_VERSION, "hera", hera_get_buildinfo()->project_version, nullptr, nullptr, nullptr, nullptr}) {}
+  // Applies the engine independent options, e.g. after the engine was replaced.
+  void configureEngine()
+  {
+    engine->setModuleCacheSize(moduleCacheSize);
+    engine->setInstancePoolSize(instancePoolSize);
+    engine->setTierUpThreshold(tierUpThreshold);
+    engine->setArtifactDirectory(artifactDirectory);
+    engine->setMemoryBudget(&memoryBudget);
+    if (benchmarking)
+      engine->enableBenchmarking();
+    if (storageCache)
+      engine->enableStorageCache();
+  }
 };
 
 using namespace evmc::literals;
@@ -144,6 +257,7 @@ pair<evmc_status_code, bytes> callSystemContract(
 }
 
 pair<evmc_status_code, bytes> locallyExecuteSystemContract(
+  WasmEngineCreateFn engineCreateFn,
   evmc::HostContext& context,
   evmc_address const& address,
   int64_t & gas,
@@ -164,7 +278,7 @@ pair<evmc_status_code, bytes> locallyExecuteSystemContract(
     .create2_salt = {},
   };
 
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
+  unique_ptr<WasmEngine> engine = engineCreateFn();
   // TODO: should we catch exceptions here?
   ExecutionResult result = engine->execute(context, code, state_code, message, false);
 
@@ -205,6 +319,21 @@ bytes sentinel(evmc::HostContext& context, bytes_view input)
   return ret;
 }
 
+#if HERA_DEBUGGING
+// Checks that code generated by evm2wasm or runevm would pass as deployed code, although
+// it is run unscanned. The CI runs the runevm state tests on a debug build for this.
+void checkGeneratedCode(char const* generator, bytes_view code)
+{
+  try {
+    ModuleScanner scanner{false};
+    scanner.feed(code);
+    scanner.finish();
+  } catch (ContractValidationFailure const& e) {
+    heraAssert(false, string{generator} + " generated an invalid contract: " + e.what());
+  }
+}
+#endif
+
 // Calls the evm2wasm contract with input data @input.
 // @returns the compiled output or empty output otherwise.
 bytes evm2wasm(evmc::HostContext& context, bytes_view input) {
@@ -229,13 +358,17 @@ bytes evm2wasm(evmc::HostContext& context, bytes_view input) {
     ContractValidationFailure,
     "evm2wasm has failed."
   );
+#if HERA_DEBUGGING
+  if (hasWasmPreamble(ret))
+    checkGeneratedCode("evm2wasm", ret);
+#endif
 
   return ret;
 }
 
 // Calls the runevm contract.
 // @returns a wasm-based evm interpreter.
-bytes runevm(evmc::HostContext& context, bytes code) {
+bytes runevm(WasmEngineCreateFn engineCreateFn, evmc::HostContext& context, bytes_view code) {
   HERA_DEBUG << "Calling runevm (code " << code.size() << " bytes)...\n";
 
   int64_t gas = numeric_limits<int64_t>::max(); // do not charge for metering yet (give unlimited gas)
@@ -243,6 +376,7 @@ bytes runevm(evmc::HostContext& context, bytes code) {
   bytes ret;
 
   tie(status, ret) = locallyExecuteSystemContract(
+      engineCreateFn,
       context,
       runevmAddress,
       gas,
@@ -268,13 +402,148 @@ bytes runevm(evmc::HostContext& context, bytes code) {
     ContractValidationFailure,
     "Runevm result has no wasm preamble."
   );
+#if HERA_DEBUGGING
+  checkGeneratedCode("runevm", ret);
+#endif
+
+  return ret;
+}
+
+// Returns the output of @transform for @input, which is only called if there is no cached output.
+// Failures are not cached, as they are reported as exceptions.
+template <typename Transform>
+bytes memoizedTransform(TransformCache& cache, char const* name, bytes_view input, Transform transform)
+{
+  if (cache.capacity() == 0)
+    return transform(input);
+
+  CodeHash inputHash = keccak256(input);
+  if (auto cached = cache.find(inputHash)) {
+    HERA_DEBUG << "Using cached " << name << " output (" << cache.hits() << " hits, " << cache.misses() << " misses).\n";
+    return *cached;
+  }
+
+  bytes ret = transform(input);
+  cache.insert(inputHash, make_shared<bytes>(ret));
+  return ret;
+}
+
+#if HERA_DEBUGGING
+// Checks with the engine that @transform kept valid code valid, as the engines are
+// otherwise left to reject broken output as if the contract was invalid. The CI fuzzes
+// a debug build with the transformations enabled for this (see HERA_FUZZ_OPTIONS).
+void checkTransformedCode(WasmEngine& engine, char const* transform, bytes_view input, bytes_view output)
+{
+  try {
+    engine.verifyContract(output);
+  } catch (ContractValidationFailure const& e) {
+    bool validInput = true;
+    try {
+      engine.verifyContract(input);
+    } catch (ContractValidationFailure const&) {
+      validInput = false;
+    }
+    heraAssert(!validInput, string{transform} + " made a valid contract invalid: " + e.what());
+    throw;
+  }
+}
+#endif
+
+// Instruments @code with native metering (see injectNativeMetering).
+bytes nativeMetering(hera_instance* hera, bytes_view code)
+{
+  bytes ret = injectNativeMetering(code);
+#if HERA_DEBUGGING
+  checkTransformedCode(*hera->engine, "native metering", code, ret);
+#else
+  (void)hera;
+#endif
+  return ret;
+}
+
+// Guards memory.grow in @code against the "memory-limit" option, as not every engine can keep
+// it on its own. Replaces @code with the guarded code, kept in @storage, if it was changed.
+void applyMemoryLimit(hera_instance* hera, bytes_view& code, bytes& storage)
+{
+  uint64_t const limit = hera->memoryBudget.executionLimit();
+  if (limit == 0)
+    return;
+
+  bytes guarded = memoizedTransform(hera->memoryLimitCache, "memory limit", code, [&](bytes_view input) {
+    bytes ret = injectMemoryLimit(input, limit);
+#if HERA_DEBUGGING
+    checkTransformedCode(*hera->engine, "memory limit", input, ret);
+#endif
+    return ret;
+  });
+  if (bytes_view{guarded} != code) {
+    storage = move(guarded);
+    code = storage;
+  }
+}
 
+// Returns the code executions of the deployed @code run, kept in @storage if it is transformed.
+bytes_view executedCode(hera_instance* hera, bytes_view code, bytes& storage)
+{
+  bytes_view ret = code;
+  if (hera->metering == hera_metering::native) {
+    storage = memoizedTransform(hera->nativeMeteringCache, "native metering", code, [&](bytes_view input) {
+      return nativeMetering(hera, input);
+    });
+    ret = storage;
+  }
+  applyMemoryLimit(hera, ret, storage);
   return ret;
 }
 
+// Returns the interpreter generated by the runevm contract, running it only the first time.
+// It only depends on the runevm code, which is executed without input.
+bytes cachedRunevm(hera_instance* hera, evmc::HostContext& context)
+{
+  lock_guard<recursive_mutex> lock{hera->runevmMutex};
+  if (hera->runevmInterpreter.empty()) {
+    // Do not insert into the preload list, it may be read concurrently.
+    auto preload = hera->contract_preload_list.find(runevmAddress);
+    bytes_view runevmCode = (preload != hera->contract_preload_list.end()) ? bytes_view{preload->second} : bytes_view{};
+    hera->runevmInterpreter = runevm(hera->engineCreateFn, context, runevmCode);
+  } else {
+    HERA_DEBUG << "Using cached runevm output.\n";
+  }
+  return hera->runevmInterpreter;
+}
+
 void hera_destroy_result(evmc_result const* result) noexcept
 {
-  delete[] result->output_data;
+  releaseOutputBuffer(result->output_data);
+}
+
+// Runs @contract for @msg, which fails without gas left if @msg does not have enough gas.
+evmc_result executeNativeContract(NativeContract const& contract, evmc_message const& msg)
+{
+  HERA_DEBUG << "Executing native contract " << contract.name << "\n";
+
+  evmc_result ret;
+  memset(&ret, 0, sizeof(evmc_result));
+
+  bytes_view input{msg.input_data, msg.input_size};
+  int64_t gas = contract.gas(input);
+  if (gas > msg.gas) {
+    ret.status_code = EVMC_OUT_OF_GAS;
+    return ret;
+  }
+
+  bytes output = contract.execute(input);
+  if (!output.empty()) {
+    uint8_t* output_data = acquireOutputBuffer(output.size());
+    copy(output.begin(), output.end(), output_data);
+    ret.output_size = output.size();
+    ret.output_data = output_data;
+    ret.release = hera_destroy_result;
+  }
+
+  ret.status_code = EVMC_SUCCESS;
+  ret.gas_left = msg.gas - gas;
+  return ret;
 }
 
 evmc_result hera_execute(
@@ -298,13 +567,20 @@ evmc_result hera_execute(
     heraAssert(rev == EVMC_BYZANTIUM, "Only Byzantium supported.");
     heraAssert(msg->gas >= 0, "EVMC supplied negative startgas");
 
+    // A native contract replaces the code at its address, but not deployments to it.
+    auto native = hera->native_contracts.find(msg->destination);
+    if (native != hera->native_contracts.end() && msg->kind != EVMC_CREATE)
+      return executeNativeContract(*native->second, *msg);
+
     bool meterInterfaceGas = true;
 
     // the bytecode residing in the state - this will be used by interface methods (i.e. codecopy)
     bytes_view state_code{code, code_size};
 
     // the actual executable code - this can be modified (metered or evm2wasm compiled)
-    bytes run_code{state_code};
+    bytes_view run_code{state_code};
+    // only used once the code is replaced by a transformed one
+    bytes run_code_storage;
 
     // replace executable code if replacement is supplied
     auto preload = hera->contract_preload_list.find(msg->destination);
@@ -313,58 +589,147 @@ evmc_result hera_execute(
       run_code = preload->second;
     }
 
-    // ensure we can only handle WebAssembly version 1
-    bool isWasm = hasWasmPreamble(run_code);
-
-    if (!isWasm) {
-      switch (hera->evm1mode) {
-      case hera_evm1mode::evm2wasm_contract:
-        run_code = evm2wasm(host, run_code);
-        ensureCondition(run_code.size() > 8, ContractValidationFailure, "Transcompiling via evm2wasm failed");
-        // TODO: enable this once evm2wasm does metering of interfaces
-        // meterInterfaceGas = false;
-        break;
-      case hera_evm1mode::fallback:
-        HERA_DEBUG << "Non-WebAssembly input, but fallback mode enabled, asking client to deal with it.\n";
-        ret.status_code = EVMC_REJECTED;
-        return ret;
-      case hera_evm1mode::reject:
-        HERA_DEBUG << "Non-WebAssembly input, failure.\n";
-        ret.status_code = EVMC_FAILURE;
-        return ret;
-      case hera_evm1mode::runevm_contract:
-        run_code = runevm(host, hera->contract_preload_list[runevmAddress]);
-        ensureCondition(run_code.size() > 8, ContractValidationFailure, "Interpreting via runevm failed");
-        // Runevm does interface metering on its own
-        meterInterfaceGas = false;
-        break;
+    // Code prepared by an earlier execution is run as is (see PreparedCode), which mostly
+    // spares nested calls from hashing and copying the code of the callee again.
+    bool const usePrepared = hera->nestedCallFastPath && hera->preparedCodeCache.capacity() > 0 &&
+      msg->kind != EVMC_CREATE && preload == hera->contract_preload_list.end();
+    CodeHash stateCodeHash{};
+    shared_ptr<PreparedCode> prepared;
+    // Set if Hera hashed the state code for the lookup, so that scanning it does not again.
+    optional<KnownCodeHash> knownStateCodeHash;
+    if (usePrepared) {
+      // The hash the client reported for the callee is only a hint, which may be stale.
+      optional<CodeHash> recordedHash = takeNestedCall(*msg);
+      if (recordedHash) {
+        stateCodeHash = *recordedHash;
+      } else {
+        stateCodeHash = codeHashOf(state_code);
+        knownStateCodeHash.emplace(state_code, stateCodeHash);
+      }
+      prepared = hera->preparedCodeCache.find(stateCodeHash);
+      if (prepared && bytes_view{prepared->stateCode} != state_code) {
+        HERA_DEBUG << "Prepared code is for another state code.\n";
+        prepared = nullptr;
       }
     }
 
-    ensureCondition(
-      hasWasmVersion(run_code, 1),
-      ContractValidationFailure,
-      "Contract has an invalid WebAssembly version."
-    );
-
-    // Avoid this in case of evm2wasm translated code
-    if (msg->kind == EVMC_CREATE && isWasm) {
-      // Meter the deployment (constructor) code if it is WebAssembly
-      if (hera->metering)
-        run_code = sentinel(host, run_code);
+    optional<CodeHash> runCodeHash;
+    if (prepared) {
+      HERA_DEBUG << "Using prepared code.\n";
+      if (prepared->transformed)
+        run_code = prepared->code;
+      runCodeHash = prepared->codeHash;
+      meterInterfaceGas = prepared->meterInterfaceGas;
+    } else {
+      // ensure we can only handle WebAssembly version 1
+      bool isWasm = hasWasmPreamble(run_code);
+
+      // Reject invalid contracts before they are metered or an engine decodes them. Only the
+      // code of the state is held to the rules of deployed code, not constructors, preloaded
+      // contracts or the code evm2wasm and runevm generate.
+      bool const scanned = isWasm && msg->kind != EVMC_CREATE && preload == hera->contract_preload_list.end();
+      // Hashing on the way, as the hash used for the lookup is not verified, unless Hera itself
+      // hashed the code already (see KnownCodeHash).
+      if (scanned)
+        stateCodeHash = scanModule(state_code);
+
+      if (!isWasm) {
+        switch (hera->evm1mode) {
+        case hera_evm1mode::evm2wasm_contract:
+          run_code_storage = memoizedTransform(hera->evm2wasmCache, "evm2wasm", run_code, [&](bytes_view input) {
+            return evm2wasm(host, input);
+          });
+          run_code = run_code_storage;
+          ensureCondition(run_code.size() > 8, ContractValidationFailure, "Transcompiling via evm2wasm failed");
+          // TODO: enable this once evm2wasm does metering of interfaces
+          // meterInterfaceGas = false;
+          break;
+        case hera_evm1mode::fallback:
+          HERA_DEBUG << "Non-WebAssembly input, but fallback mode enabled, asking client to deal with it.\n";
+          ret.status_code = EVMC_REJECTED;
+          return ret;
+        case hera_evm1mode::reject:
+          HERA_DEBUG << "Non-WebAssembly input, failure.\n";
+          ret.status_code = EVMC_FAILURE;
+          return ret;
+        case hera_evm1mode::runevm_contract:
+          run_code_storage = cachedRunevm(hera, host);
+          run_code = run_code_storage;
+          ensureCondition(run_code.size() > 8, ContractValidationFailure, "Interpreting via runevm failed");
+          // Runevm does interface metering on its own
+          meterInterfaceGas = false;
+          break;
+        }
+      }
+
       ensureCondition(
-        hasWasmPreamble(run_code) && hasWasmVersion(run_code, 1),
+        hasWasmVersion(run_code, 1),
         ContractValidationFailure,
-        "Invalid contract or metering failed."
+        "Contract has an invalid WebAssembly version."
       );
+
+      // Avoid this in case of evm2wasm translated code
+      if (hera->metering == hera_metering::native && isWasm) {
+        // The code is stored as deployed, so it is metered on every execution
+        run_code_storage = memoizedTransform(hera->nativeMeteringCache, "native metering", run_code, [&](bytes_view input) {
+          return nativeMetering(hera, input);
+        });
+        run_code = run_code_storage;
+      } else if (msg->kind == EVMC_CREATE && isWasm) {
+        // Meter the deployment (constructor) code if it is WebAssembly
+        if (hera->metering == hera_metering::sentinel_contract) {
+          run_code_storage = memoizedTransform(hera->sentinelCache, "sentinel", run_code, [&](bytes_view input) {
+            return sentinel(host, input);
+          });
+          run_code = run_code_storage;
+        }
+        ensureCondition(
+          hasWasmPreamble(run_code) && hasWasmVersion(run_code, 1),
+          ContractValidationFailure,
+          "Invalid contract or metering failed."
+        );
+      }
+
+      applyMemoryLimit(hera, run_code, run_code_storage);
+
+      if (run_code.data() == state_code.data() && scanned)
+        runCodeHash = stateCodeHash;
+
+      if (usePrepared) {
+        prepared = make_shared<PreparedCode>();
+        prepared->stateCode = bytes{state_code};
+        prepared->transformed = !run_code_storage.empty();
+        prepared->code = move(run_code_storage);
+        // Code run untransformed was scanned, so its hash is verified.
+        prepared->codeHash = prepared->transformed ? keccak256(prepared->code) : stateCodeHash;
+        runCodeHash = prepared->codeHash;
+        prepared->meterInterfaceGas = meterInterfaceGas;
+        if (prepared->transformed)
+          run_code = prepared->code;
+        hera->preparedCodeCache.insert(stateCodeHash, prepared);
+      }
     }
 
     heraAssert(hera->engine, "Wasm engine not set.");
     WasmEngine& engine = *hera->engine;
 
+    NestedCallRecording recording{hera->nestedCallFastPath};
+    optional<KnownCodeHash> knownHash;
+    if (runCodeHash)
+      knownHash.emplace(run_code, *runCodeHash);
     ExecutionResult result = engine.execute(host, run_code, state_code, *msg, meterInterfaceGas);
     heraAssert(result.gasLeft >= 0, "Negative gas left after execution.");
 
+    if (hera->benchmarking)
+      logBenchmark(BenchmarkRecord{
+        usePrepared ? stateCodeHash : codeHashOf(state_code),
+        msg->kind,
+        msg->depth,
+        msg->gas - result.gasLeft,
+        result.instantiationTime.count(),
+        result.executionTime.count()
+      });
+
     // copy call result
     if (result.returnValue.size() > 0) {
       bytes returnValue;
@@ -377,24 +742,43 @@ evmc_result hera_execute(
         );
 
         // Meter the deployed code if it is WebAssembly
-        returnValue = hera->metering ? sentinel(host, result.returnValue) : move(result.returnValue);
+        if (hera->metering == hera_metering::sentinel_contract) {
+          returnValue = memoizedTransform(hera->sentinelCache, "sentinel", result.returnValue, [&](bytes_view input) {
+            return sentinel(host, input);
+          });
+          releaseBuffer(move(result.returnValue));
+        } else {
+          returnValue = move(result.returnValue);
+        }
         ensureCondition(
           hasWasmPreamble(returnValue) && hasWasmVersion(returnValue, 1),
           ContractValidationFailure,
           "Invalid contract or metering failed."
         );
         // FIXME: this should be done by the sentinel
-        engine.verifyContract({returnValue.data(), returnValue.size()});
+        bytes_view deployedCode{returnValue.data(), returnValue.size()};
+        // Only the scan, the engines time their own validation.
+        PhaseTimer phases;
+        phases.start(Phase::validate);
+        CodeHash deployedCodeHash = scanModule(deployedCode);
+        phases.stop();
+        KnownCodeHash deployedHash{deployedCode, deployedCodeHash};
+        // Only the code its executions run is kept, it contains the deployed code.
+        bytes executedStorage;
+        engine.verifyContract(executedCode(hera, deployedCode, executedStorage));
       } else {
         returnValue = move(result.returnValue);
       }
 
-      uint8_t* output_data = new uint8_t[returnValue.size()];
+      uint8_t* output_data = acquireOutputBuffer(returnValue.size());
       copy(returnValue.begin(), returnValue.end(), output_data);
 
       ret.output_size = returnValue.size();
       ret.output_data = output_data;
       ret.release = hera_destroy_result;
+      releaseBuffer(move(returnValue));
+    } else {
+      releaseBuffer(move(result.returnValue));
     }
 
     ret.status_code = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
@@ -421,6 +805,9 @@ evmc_result hera_execute(
   } catch (StaticModeViolation const& e) {
     ret.status_code = EVMC_STATIC_MODE_VIOLATION;
     HERA_DEBUG << e.what() << "\n";
+  } catch (MemoryBudgetExceeded const& e) {
+    ret.status_code = EVMC_OUT_OF_MEMORY;
+    HERA_DEBUG << e.what() << "\n";
   } catch (InternalErrorException const& e) {
     ret.status_code = EVMC_INTERNAL_ERROR;
     HERA_DEBUG << "InternalError: " << e.what() << "\n";
@@ -435,6 +822,82 @@ evmc_result hera_execute(
   return ret;
 }
 
+// Calls @work for each index below @count, on up to @threads threads including the calling one.
+template <typename Work>
+void runOnThreads(size_t count, size_t threads, Work work) noexcept
+{
+  atomic<size_t> next{0};
+  auto run = [&]() noexcept {
+    for (size_t i = next++; i < count; i = next++)
+      work(i);
+  };
+
+  vector<thread> workers;
+  for (size_t i = 1; i < min(threads, count); ++i) {
+    try {
+      workers.emplace_back(run);
+    } catch (...) {
+      // Continue with the threads started so far.
+      break;
+    }
+  }
+  run();
+  for (thread& worker: workers)
+    worker.join();
+}
+
+// Validates the deployed @code and fills the engine caches with the code its executions
+// run (natively metered and guarded against the memory limit if enabled), only verifying
+// those. Needs no host, so code which only the sentinel or evm2wasm contracts could prepare
+// is left alone. Returns false if @code is rejected.
+bool warmUp(hera_instance* hera, bytes_view code) noexcept
+{
+  try {
+    if (!hasWasmPreamble(code) || !hasWasmVersion(code, 1)) {
+      HERA_DEBUG << "Not warming up non-WebAssembly code.\n";
+      return false;
+    }
+
+    WasmEngine& engine = *hera->engine;
+    KnownCodeHash knownHash{code, scanModule(code)};
+    bytes executedStorage;
+    bytes_view executed = executedCode(hera, code, executedStorage);
+    // Interpreters keep what they verified.
+    if (!engine.precompile(executed))
+      engine.verifyContract(executed);
+    return true;
+  } catch (exception const& e) {
+    HERA_DEBUG << "Warming up failed: " << e.what() << "\n";
+    return false;
+  }
+}
+
+// Warms up with every ".wasm" file in @directory, on all cores.
+bool hera_preload_directory(hera_instance* hera, string const& directory)
+{
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    HERA_DEBUG << "Failed to open preload directory: " << directory << "\n";
+    return false;
+  }
+
+  vector<bytes> contents;
+  while (dirent* entry = readdir(dir)) {
+    string name = entry->d_name;
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".wasm") == 0)
+      contents.push_back(loadFileContents(directory + "/" + name));
+  }
+  closedir(dir);
+
+  atomic<size_t> accepted{0};
+  runOnThreads(contents.size(), max(thread::hardware_concurrency(), 1u), [&](size_t i) noexcept {
+    if (warmUp(hera, contents[i]))
+      ++accepted;
+  });
+  HERA_DEBUG << "Preloaded " << accepted << " of " << contents.size() << " contracts from " << directory << "\n";
+  return true;
+}
+
 bool hera_parse_sys_option(hera_instance *hera, string const& _name, string const& value)
 {
   heraAssert(_name.find("sys:") == 0, "");
@@ -470,6 +933,18 @@ bool hera_parse_sys_option(hera_instance *hera, string const& _name, string cons
     address = aliases.at(name);
   }
 
+  if (value.find("native:") == 0) {
+    NativeContract const* contract = findNativeContract(string_view{value}.substr(7));
+    if (!contract) {
+      HERA_DEBUG << "Unknown native contract: " << value << "\n";
+      return false;
+    }
+
+    HERA_DEBUG << "Bound native contract " << contract->name << " to " << name << "\n";
+    hera->native_contracts[address] = contract;
+    return true;
+  }
+
   bytes contents = loadFileContents(value);
   if (contents.size() == 0) {
     HERA_DEBUG << "Failed to load contract source (or empty): " << value << "\n";
@@ -479,6 +954,18 @@ bool hera_parse_sys_option(hera_instance *hera, string const& _name, string cons
   HERA_DEBUG << "Loaded contract for " << name << " from " << value << " (" << contents.size() << " bytes)\n";
 
   hera->contract_preload_list[address] = move(contents);
+  hera->native_contracts.erase(address);
+
+  // Memoized outputs of a replaced system contract are stale.
+  hera->preparedCodeCache.clear();
+  if (address == sentinelAddress)
+    hera->sentinelCache.clear();
+  else if (address == evm2wasmAddress)
+    hera->evm2wasmCache.clear();
+  else if (address == runevmAddress) {
+    lock_guard<recursive_mutex> lock{hera->runevmMutex};
+    hera->runevmInterpreter.clear();
+  }
 
   return true;
 }
@@ -493,37 +980,156 @@ evmc_set_option_result hera_set_option(
   if (strcmp(name, "evm1mode") == 0) {
     if (evm1mode_options.count(value)) {
       hera->evm1mode = evm1mode_options.at(value);
+      hera->preparedCodeCache.clear();
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
   if (strcmp(name, "metering") == 0) {
-    if (strcmp(value, "true") == 0)
-      hera->metering = true;
-    else if (strcmp(value, "false") != 0)
-      return EVMC_SET_OPTION_INVALID_VALUE;
-    return EVMC_SET_OPTION_SUCCESS;
+    if (metering_options.count(value)) {
+      hera->metering = metering_options.at(value);
+      hera->preparedCodeCache.clear();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
   if (strcmp(name, "benchmark") == 0) {
     if (strcmp(value, "true") == 0) {
-      WasmEngine::enableBenchmarking();
+      hera->benchmarking = true;
+      hera->engine->enableBenchmarking();
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+  if (strcmp(name, "storage-cache") == 0) {
+    if (strcmp(value, "true") == 0) {
+      hera->storageCache = true;
+      hera->engine->enableStorageCache();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "nested-call-fast-path") == 0) {
+    if (strcmp(value, "true") == 0) {
+      hera->nestedCallFastPath = true;
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "trace") == 0) {
+    auto it = trace_options.find(value);
+    if (it != trace_options.end() && setTraceLevel(it->second))
+      return EVMC_SET_OPTION_SUCCESS;
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "evm-trace") == 0) {
+    if (debugging && openEvmTraceSink(value))
+      return EVMC_SET_OPTION_SUCCESS;
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "metrics") == 0) {
+    if (strcmp(value, "true") == 0) {
+      enableMetrics();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "metrics-dump") == 0) {
+    // JSON if the file name says so, the Prometheus text format otherwise.
+    size_t length = strlen(value);
+    bool json = length >= 5 && strcmp(value + length - 5, ".json") == 0;
+    ofstream file{value, ios::out | ios::trunc};
+    if (!file)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    file << dumpMetrics(json ? MetricsFormat::json : MetricsFormat::prometheus);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strcmp(name, "engine") == 0) {
     auto it = wasm_engine_map.find(value);
     if (it != wasm_engine_map.end()) {
-      wasmEngineCreateFn = it->second;
-      hera->engine = wasmEngineCreateFn();
+      hera->engineCreateFn = it->second;
+      hera->engine = hera->engineCreateFn();
+      hera->configureEngine();
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+  if (strcmp(name, "cache-size") == 0) {
+    uint64_t size;
+    if (!parseDecimalString(value, size) || size > numeric_limits<size_t>::max())
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->moduleCacheSize = static_cast<size_t>(size);
+    hera->engine->setModuleCacheSize(hera->moduleCacheSize);
+    hera->sentinelCache.setCapacity(hera->moduleCacheSize);
+    hera->evm2wasmCache.setCapacity(hera->moduleCacheSize);
+    hera->nativeMeteringCache.setCapacity(hera->moduleCacheSize);
+    hera->memoryLimitCache.setCapacity(hera->moduleCacheSize);
+    hera->preparedCodeCache.setCapacity(hera->moduleCacheSize);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "instance-pool-size") == 0) {
+    uint64_t size;
+    if (!parseDecimalString(value, size) || size > numeric_limits<size_t>::max())
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->instancePoolSize = static_cast<size_t>(size);
+    hera->engine->setInstancePoolSize(hera->instancePoolSize);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "tier-up-threshold") == 0) {
+    uint64_t threshold;
+    if (!parseDecimalString(value, threshold))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->tierUpThreshold = threshold;
+    hera->engine->setTierUpThreshold(hera->tierUpThreshold);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "memory-limit") == 0) {
+    uint64_t pages;
+    if (!parseDecimalString(value, pages))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->memoryBudget.setExecutionLimit(pages);
+    // Both hold code guarded against the previous limit.
+    hera->memoryLimitCache.clear();
+    hera->preparedCodeCache.clear();
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "memory-budget") == 0) {
+    uint64_t pages;
+    if (!parseDecimalString(value, pages))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->memoryBudget.setBudget(pages);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "preload") == 0) {
+    if (hera_preload_directory(hera, value))
+      return EVMC_SET_OPTION_SUCCESS;
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "cache-dir") == 0) {
+    hera->artifactDirectory = value;
+    // Paths are joined with a slash, so drop a trailing one.
+    while (hera->artifactDirectory.size() > 1 && hera->artifactDirectory.back() == '/')
+      hera->artifactDirectory.pop_back();
+    hera->engine->setArtifactDirectory(hera->artifactDirectory);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strncmp(name, "sys:", 4) == 0) {
     if (hera_parse_sys_option(hera, string(name), string(value)))
       return EVMC_SET_OPTION_SUCCESS;
@@ -561,6 +1167,86 @@ evmc_vm* evmc_create_hera() noexcept
   return instance;
 }
 
+size_t hera_dump_metrics(char const* format, char* buffer, size_t buffer_size) noexcept
+{
+  MetricsFormat metricsFormat;
+  if (strcmp(format, "json") == 0)
+    metricsFormat = MetricsFormat::json;
+  else if (strcmp(format, "prometheus") == 0)
+    metricsFormat = MetricsFormat::prometheus;
+  else
+    return 0;
+
+  try {
+    string dump = dumpMetrics(metricsFormat);
+    if (buffer && buffer_size > dump.size())
+      memcpy(buffer, dump.c_str(), dump.size() + 1);
+    return dump.size();
+  } catch (...) {
+    return 0;
+  }
+}
+
+void hera_execute_batch(
+  evmc_vm* vm,
+  evmc_host_interface const* host,
+  evmc_host_context* context,
+  evmc_revision rev,
+  hera_batch_message const* messages,
+  size_t count,
+  evmc_result* results,
+  size_t threads
+) noexcept {
+  struct Group {
+    CodeHash codeHash;
+    bytes_view code;
+    vector<size_t> messages;
+  };
+
+  // Executes the messages of @group in order, without hashing the code again.
+  auto executeGroup = [&](Group const& group) noexcept {
+    KnownCodeHash knownHash{group.code, group.codeHash};
+    for (size_t i: group.messages)
+      results[i] = hera_execute(vm, host, context, rev, messages[i].message, messages[i].code, messages[i].code_size);
+  };
+
+  vector<Group> groups;
+  try {
+    unordered_map<CodeHash, size_t, CodeHashHasher> groupIndices;
+    // Messages usually share the very same code buffers, which are only hashed once.
+    map<pair<uint8_t const*, size_t>, CodeHash> bufferHashes;
+    for (size_t i = 0; i < count; ++i) {
+      bytes_view code{messages[i].code, messages[i].code_size};
+      auto buffer = bufferHashes.emplace(make_pair(code.data(), code.size()), CodeHash{});
+      if (buffer.second)
+        buffer.first->second = keccak256(code);
+      CodeHash const& codeHash = buffer.first->second;
+      auto inserted = groupIndices.emplace(codeHash, groups.size());
+      if (inserted.second)
+        groups.push_back(Group{codeHash, code, {}});
+      groups[inserted.first->second].messages.push_back(i);
+    }
+  } catch (...) {
+    // Out of memory, execute every message on its own.
+    for (size_t i = 0; i < count; ++i)
+      results[i] = hera_execute(vm, host, context, rev, messages[i].message, messages[i].code, messages[i].code_size);
+    return;
+  }
+
+  runOnThreads(groups.size(), threads, [&](size_t i) noexcept { executeGroup(groups[i]); });
+}
+
+size_t hera_warm_up(evmc_vm* vm, hera_code const* codes, size_t count, size_t threads) noexcept
+{
+  hera_instance* hera = static_cast<hera_instance*>(vm);
+  atomic<size_t> accepted{0};
+  runOnThreads(count, threads, [&](size_t i) noexcept {
+    if (warmUp(hera, {codes[i].code, codes[i].code_size}))
+      ++accepted;
+  });
+  return accepted;
+}
+
 #if hera_EXPORTS
 // If compiled as shared library, also export this symbol.
 EVMC_EXPORT evmc_vm* evmc_create() noexcept
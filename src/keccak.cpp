@@ -0,0 +1,176 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "keccak.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+constexpr size_t rate = 136;
+
+thread_local KnownCodeHash const* knownCodeHash = nullptr;
+
+constexpr uint64_t roundConstants[24] = {
+  0x0000000000000001, 0x0000000000008082, 0x800000000000808a, 0x8000000080008000,
+  0x000000000000808b, 0x0000000080000001, 0x8000000080008081, 0x8000000000008009,
+  0x000000000000008a, 0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+  0x000000008000808b, 0x800000000000008b, 0x8000000000008089, 0x8000000000008003,
+  0x8000000000008002, 0x8000000000000080, 0x000000000000800a, 0x800000008000000a,
+  0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008,
+};
+
+constexpr unsigned rotations[24] = {
+  1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+
+constexpr unsigned piLanes[24] = {
+  10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+inline uint64_t rotl(uint64_t x, unsigned s) noexcept
+{
+  return (x << s) | (x >> (64 - s));
+}
+
+void keccakf(uint64_t state[25]) noexcept
+{
+  uint64_t bc[5];
+  for (unsigned round = 0; round < 24; ++round) {
+    // Theta
+    for (unsigned i = 0; i < 5; ++i)
+      bc[i] = state[i] ^ state[i + 5] ^ state[i + 10] ^ state[i + 15] ^ state[i + 20];
+    for (unsigned i = 0; i < 5; ++i) {
+      uint64_t t = bc[(i + 4) % 5] ^ rotl(bc[(i + 1) % 5], 1);
+      for (unsigned j = 0; j < 25; j += 5)
+        state[j + i] ^= t;
+    }
+
+    // Rho and Pi
+    uint64_t t = state[1];
+    for (unsigned i = 0; i < 24; ++i) {
+      unsigned j = piLanes[i];
+      uint64_t tmp = state[j];
+      state[j] = rotl(t, rotations[i]);
+      t = tmp;
+    }
+
+    // Chi
+    for (unsigned j = 0; j < 25; j += 5) {
+      for (unsigned i = 0; i < 5; ++i)
+        bc[i] = state[j + i];
+      for (unsigned i = 0; i < 5; ++i)
+        state[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+    }
+
+    // Iota
+    state[0] ^= roundConstants[round];
+  }
+}
+
+// Lanes are little-endian regardless of the host byte order.
+inline void absorb(uint64_t state[25], uint8_t const* block) noexcept
+{
+  for (size_t i = 0; i < rate / 8; ++i) {
+    uint64_t lane = 0;
+    for (unsigned b = 0; b < 8; ++b)
+      lane |= uint64_t(block[i * 8 + b]) << (8 * b);
+    state[i] ^= lane;
+  }
+  keccakf(state);
+}
+
+}
+
+evmc::bytes32 keccak256(bytes_view input) noexcept
+{
+  Keccak256 hasher;
+  hasher.update(input);
+  return hasher.finish();
+}
+
+void Keccak256::update(bytes_view input) noexcept
+{
+  uint8_t const* data = input.data();
+  size_t remaining = input.size();
+
+  // Complete the block of the previous input first.
+  if (m_blockSize > 0) {
+    size_t length = min(remaining, rate - m_blockSize);
+    copy(data, data + length, m_block + m_blockSize);
+    m_blockSize += length;
+    data += length;
+    remaining -= length;
+    if (m_blockSize < rate)
+      return;
+    absorb(m_state, m_block);
+    m_blockSize = 0;
+  }
+
+  while (remaining >= rate) {
+    absorb(m_state, data);
+    data += rate;
+    remaining -= rate;
+  }
+
+  copy(data, data + remaining, m_block);
+  m_blockSize = remaining;
+}
+
+evmc::bytes32 Keccak256::finish() noexcept
+{
+  fill(m_block + m_blockSize, m_block + rate, uint8_t{0});
+  m_block[m_blockSize] ^= 0x01;
+  m_block[rate - 1] ^= 0x80;
+  absorb(m_state, m_block);
+
+  evmc::bytes32 ret;
+  for (size_t i = 0; i < sizeof(ret.bytes); ++i)
+    ret.bytes[i] = static_cast<uint8_t>(m_state[i / 8] >> (8 * (i % 8)));
+  return ret;
+}
+
+KnownCodeHash::KnownCodeHash(bytes_view code, evmc::bytes32 const& hash) noexcept:
+  m_code(code), m_hash(hash), m_previous(knownCodeHash)
+{
+  knownCodeHash = this;
+}
+
+KnownCodeHash::~KnownCodeHash() noexcept
+{
+  knownCodeHash = m_previous;
+}
+
+optional<evmc::bytes32> knownCodeHashOf(bytes_view code) noexcept
+{
+  if (knownCodeHash && knownCodeHash->m_code.data() == code.data() && knownCodeHash->m_code.size() == code.size())
+    return knownCodeHash->m_hash;
+  return nullopt;
+}
+
+evmc::bytes32 codeHashOf(bytes_view code) noexcept
+{
+  if (optional<evmc::bytes32> known = knownCodeHashOf(code))
+    return *known;
+  return keccak256(code);
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <optional>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+
+namespace hera {
+
+// Returns the Keccak-256 (original Keccak padding, as used by Ethereum) hash of @input.
+evmc::bytes32 keccak256(bytes_view input) noexcept;
+
+// Computes keccak256() of input given in parts, e.g. while it is received.
+class Keccak256 {
+public:
+  void update(bytes_view input) noexcept;
+  // Returns the hash of all input so far. The hasher cannot be updated afterwards.
+  evmc::bytes32 finish() noexcept;
+
+private:
+  static constexpr size_t rate = 136;
+
+  uint64_t m_state[25] = {};
+  uint8_t m_block[rate] = {};
+  size_t m_blockSize = 0;
+};
+
+// Tells codeHashOf() the hash of @code on this thread while in scope, for code whose hash
+// the caller already knows. Scopes nest, e.g. for nested executions.
+class KnownCodeHash {
+public:
+  KnownCodeHash(bytes_view code, evmc::bytes32 const& hash) noexcept;
+  ~KnownCodeHash() noexcept;
+
+  KnownCodeHash(KnownCodeHash const&) = delete;
+  KnownCodeHash& operator=(KnownCodeHash const&) = delete;
+
+private:
+  friend std::optional<evmc::bytes32> knownCodeHashOf(bytes_view code) noexcept;
+
+  bytes_view const m_code;
+  evmc::bytes32 const m_hash;
+  KnownCodeHash const* const m_previous;
+};
+
+// Returns the hash of @code if it is the code of the innermost KnownCodeHash, i.e. the very
+// same bytes (not merely equal ones).
+std::optional<evmc::bytes32> knownCodeHashOf(bytes_view code) noexcept;
+
+// Returns keccak256(@code), without hashing if its hash is known (see knownCodeHashOf()).
+evmc::bytes32 codeHashOf(bytes_view code) noexcept;
+
+}
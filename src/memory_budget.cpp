@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "exceptions.h"
+#include "memory_budget.h"
+#include "metrics.h"
+
+using namespace std;
+
+namespace hera {
+
+MemoryReservation::MemoryReservation(MemoryBudget* budget, uint64_t initialPages, uint64_t maximumPages):
+  m_budget(budget)
+{
+  if (!m_budget)
+    return;
+
+  checkLimit(initialPages);
+
+  uint64_t reachable = m_budget->limitMaximum(maximumPages);
+  uint64_t pages = max(initialPages, reachable);
+  uint64_t budgetPages = m_budget->m_budget.load(memory_order_relaxed);
+  uint64_t reserved = m_budget->m_reserved.load(memory_order_relaxed);
+  do {
+    if (budgetPages && reserved + pages > budgetPages) {
+      recordMemoryReservation(pages, false);
+      throw MemoryBudgetExceeded{"Memory budget exhausted, " + to_string(reserved) + " pages are reserved."};
+    }
+  } while (!m_budget->m_reserved.compare_exchange_weak(reserved, reserved + pages, memory_order_relaxed));
+
+  m_pages = pages;
+  recordMemoryReservation(pages, true);
+}
+
+void MemoryReservation::checkLimit(uint64_t pages) const
+{
+  if (!m_budget)
+    return;
+  uint64_t limit = m_budget->executionLimit();
+  ensureCondition(!limit || pages <= limit, VMTrap, "Memory of " + to_string(pages) + " pages exceeds the memory limit.");
+}
+
+MemoryReservation::~MemoryReservation() noexcept
+{
+  if (m_budget)
+    m_budget->m_reserved.fetch_sub(m_pages, memory_order_relaxed);
+}
+
+}
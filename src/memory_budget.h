@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace hera {
+
+/// The most pages a memory of 32-bit WebAssembly can have, of 64 KiB each.
+constexpr uint64_t maxWasmPages = 65536;
+
+/// Bounds the linear memory of executions, in pages (see the "memory-limit" and
+/// "memory-budget" options). Zero disables either bound.
+///
+/// The code executed traps when memory.grow goes beyond the execution limit (see
+/// injectMemoryLimit), and engines also lower the declared maximum of the memory of an
+/// execution to the limit where they can, so the memory cannot exceed the limit, and
+/// executions starting with more memory trap. For the whole of
+/// its duration an execution reserves the most pages it can reach from the budget, which is
+/// shared by all concurrent executions of the VM (see MemoryReservation).
+class MemoryBudget {
+public:
+  void setExecutionLimit(uint64_t pages) noexcept { m_executionLimit.store(pages, std::memory_order_relaxed); }
+  void setBudget(uint64_t pages) noexcept { m_budget.store(pages, std::memory_order_relaxed); }
+
+  uint64_t executionLimit() const noexcept { return m_executionLimit.load(std::memory_order_relaxed); }
+
+  /// Returns the declared @maximum pages of a memory lowered to the execution limit.
+  uint64_t limitMaximum(uint64_t maximum) const noexcept
+  {
+    uint64_t limit = executionLimit();
+    return std::min(maximum, limit ? limit : maxWasmPages);
+  }
+
+private:
+  friend class MemoryReservation;
+
+  std::atomic<uint64_t> m_executionLimit{0};
+  std::atomic<uint64_t> m_budget{0};
+  std::atomic<uint64_t> m_reserved{0};
+};
+
+/// Reserves the memory an execution can reach from a MemoryBudget while in scope.
+/// Throws VMTrap if the memory starts above the execution limit, and MemoryBudgetExceeded
+/// if the budget is used up by other executions. A null budget imposes no bounds.
+class MemoryReservation {
+public:
+  MemoryReservation(MemoryBudget* budget, uint64_t initialPages, uint64_t maximumPages);
+  ~MemoryReservation() noexcept;
+
+  MemoryReservation(MemoryReservation const&) = delete;
+  MemoryReservation& operator=(MemoryReservation const&) = delete;
+
+  /// Throws VMTrap if a memory of @pages exceeds the execution limit. For engines with a
+  /// hook for memory.grow, which cannot lower the maximum of a memory.
+  void checkLimit(uint64_t pages) const;
+
+private:
+  MemoryBudget* const m_budget;
+  uint64_t m_pages = 0;
+};
+
+}
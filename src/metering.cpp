@@ -0,0 +1,951 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include "exceptions.h"
+#include "memory_budget.h"
+#include "metering.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// The cost of every instruction, as in the default cost table of the sentinel.
+constexpr uint64_t instructionCost = 1;
+
+// The accumulated gas is charged at loop headers and function entries once it exceeds this.
+constexpr uint64_t flushThreshold = 1 << 16;
+
+enum SectionId : uint8_t {
+  customSection = 0,
+  typeSection = 1,
+  importSection = 2,
+  functionSection = 3,
+  globalSection = 6,
+  exportSection = 7,
+  startSection = 8,
+  elementSection = 9,
+  codeSection = 10,
+  dataSection = 11,
+};
+
+enum Opcode : uint8_t {
+  opUnreachable = 0x00,
+  opBlock = 0x02,
+  opLoop = 0x03,
+  opIf = 0x04,
+  opElse = 0x05,
+  opEnd = 0x0b,
+  opBr = 0x0c,
+  opBrIf = 0x0d,
+  opBrTable = 0x0e,
+  opReturn = 0x0f,
+  opCall = 0x10,
+  opCallIndirect = 0x11,
+  opGetGlobal = 0x23,
+  opSetGlobal = 0x24,
+  opCurrentMemory = 0x3f,
+  opGrowMemory = 0x40,
+  opI32Const = 0x41,
+  opI64Const = 0x42,
+  opF32Const = 0x43,
+  opF64Const = 0x44,
+  opI64Eqz = 0x50,
+  opI64GtU = 0x56,
+  opI64Add = 0x7c,
+  opI64ExtendUI32 = 0xad,
+};
+
+constexpr uint8_t typeI32 = 0x7f;
+constexpr uint8_t typeI64 = 0x7e;
+constexpr uint8_t typeFunc = 0x60;
+constexpr uint8_t blockTypeEmpty = 0x40;
+constexpr uint8_t externalFunction = 0;
+constexpr uint8_t externalTable = 1;
+constexpr uint8_t externalMemory = 2;
+constexpr uint8_t externalGlobal = 3;
+
+void ensureWellFormed(bool condition)
+{
+  ensureCondition(condition, ContractValidationFailure, "Malformed module, cannot instrument it.");
+}
+
+class Reader {
+public:
+  explicit Reader(bytes_view data) noexcept: m_data(data) {}
+
+  bool done() const noexcept { return m_position == m_data.size(); }
+  size_t position() const noexcept { return m_position; }
+  bytes_view rest() const noexcept { return m_data.substr(m_position); }
+  bytes_view slice(size_t from) const noexcept { return m_data.substr(from, m_position - from); }
+
+  uint8_t byte()
+  {
+    ensureWellFormed(m_position < m_data.size());
+    return m_data[m_position++];
+  }
+
+  bytes_view take(size_t length)
+  {
+    ensureWellFormed(length <= m_data.size() - m_position);
+    bytes_view ret = m_data.substr(m_position, length);
+    m_position += length;
+    return ret;
+  }
+
+  uint32_t u32()
+  {
+    uint32_t ret = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+      uint8_t b = byte();
+      ret |= uint32_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        ensureWellFormed(shift < 28 || (b >> 4) == 0);
+        return ret;
+      }
+    }
+    ensureWellFormed(false);
+    return 0;
+  }
+
+  // Skips a signed LEB128 value of at most @maxBytes bytes.
+  void skipSigned(unsigned maxBytes)
+  {
+    for (unsigned i = 0; i < maxBytes; ++i)
+      if (!(byte() & 0x80))
+        return;
+    ensureWellFormed(false);
+  }
+
+  bytes_view name() { return take(u32()); }
+
+  void skipLimits()
+  {
+    uint32_t flags = u32();
+    u32();
+    if (flags & 1)
+      u32();
+  }
+
+private:
+  bytes_view m_data;
+  size_t m_position = 0;
+};
+
+void writeU32(bytes& out, uint32_t value)
+{
+  do {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    if (value)
+      b |= 0x80;
+    out.push_back(b);
+  } while (value);
+}
+
+void writeS64(bytes& out, int64_t value)
+{
+  bool more = true;
+  while (more) {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    more = !((value == 0 && !(b & 0x40)) || (value == -1 && (b & 0x40)));
+    if (more)
+      b |= 0x80;
+    out.push_back(b);
+  }
+}
+
+void writeSection(bytes& out, uint8_t id, bytes const& payload)
+{
+  out.push_back(id);
+  writeU32(out, static_cast<uint32_t>(payload.size()));
+  out += payload;
+}
+
+struct FunctionType {
+  bytes params;
+  bytes results;
+
+  bool operator==(FunctionType const& other) const { return params == other.params && results == other.results; }
+};
+
+struct Section {
+  uint8_t id;
+  bytes_view payload;
+};
+
+vector<Section> readSections(bytes_view code)
+{
+  ensureWellFormed(hasWasmPreamble(code) && hasWasmVersion(code, 1));
+  vector<Section> ret;
+  Reader reader{code.substr(8)};
+  while (!reader.done()) {
+    uint8_t id = reader.byte();
+    ensureWellFormed(id <= dataSection);
+    bytes_view payload = reader.take(reader.u32());
+    ret.push_back({id, payload});
+  }
+  return ret;
+}
+
+// A decoded instruction, with the opcode and all its immediates in @raw.
+struct Instruction {
+  uint8_t opcode;
+  bytes_view raw;
+  // The function index of a call.
+  uint32_t callee = 0;
+};
+
+Instruction readInstruction(Reader& reader)
+{
+  size_t start = reader.position();
+  Instruction ret;
+  ret.opcode = reader.byte();
+  switch (ret.opcode) {
+  case opBlock:
+  case opLoop:
+  case opIf:
+    // A value type or an (s33) type index.
+    reader.skipSigned(5);
+    break;
+  case opBr:
+  case opBrIf:
+  case 0x20: // get_local
+  case 0x21: // set_local
+  case 0x22: // tee_local
+  case opGetGlobal:
+  case opSetGlobal:
+    reader.u32();
+    break;
+  case opBrTable:
+    for (uint32_t count = reader.u32(); count > 0; --count)
+      reader.u32();
+    reader.u32();
+    break;
+  case opCall:
+    ret.callee = reader.u32();
+    break;
+  case opCallIndirect:
+    reader.u32();
+    reader.byte();
+    break;
+  case opCurrentMemory:
+  case opGrowMemory:
+    reader.byte();
+    break;
+  case opI32Const:
+    reader.skipSigned(5);
+    break;
+  case opI64Const:
+    reader.skipSigned(10);
+    break;
+  case opF32Const:
+    reader.take(4);
+    break;
+  case opF64Const:
+    reader.take(8);
+    break;
+  default:
+    if (ret.opcode >= 0x28 && ret.opcode <= 0x3e) {
+      // loads and stores have alignment and offset
+      reader.u32();
+      reader.u32();
+    } else {
+      // Everything else up to the sign extension operators has no immediates.
+      ensureCondition(
+        ret.opcode <= 0x01 || ret.opcode == opElse || ret.opcode == opEnd || ret.opcode == opReturn ||
+          ret.opcode == 0x1a || ret.opcode == 0x1b || (ret.opcode >= 0x45 && ret.opcode <= 0xc4),
+        ContractValidationFailure,
+        "Unsupported instruction, cannot instrument the module."
+      );
+    }
+    break;
+  }
+  ret.raw = reader.slice(start);
+  return ret;
+}
+
+// Instructions after which control flow can continue elsewhere or arrive from elsewhere.
+bool endsSegment(uint8_t opcode) noexcept
+{
+  switch (opcode) {
+  case opUnreachable:
+  case opLoop:
+  case opIf:
+  case opElse:
+  case opEnd:
+  case opBr:
+  case opBrIf:
+  case opBrTable:
+  case opReturn:
+    return true;
+  default:
+    return false;
+  }
+}
+
+class MeteringInjector {
+public:
+  explicit MeteringInjector(bytes_view code): m_code(code) {}
+
+  bytes run();
+
+private:
+  void readTypes(bytes_view payload);
+  void readImports(bytes_view payload);
+  void readFunctions(bytes_view payload);
+  void readGlobals(bytes_view payload);
+
+  uint32_t findOrAddType(FunctionType const& type);
+  uint32_t shifted(uint32_t function) const noexcept { return (m_addImport && function >= m_numFunctionImports) ? function + 1 : function; }
+  bool isImport(uint32_t function) const noexcept { return function < m_numFunctionImports; }
+
+  bytes typeSectionPayload() const;
+  bytes importSectionPayload(bytes_view payload) const;
+  bytes functionSectionPayload(bytes_view payload) const;
+  bytes globalSectionPayload(bytes_view payload) const;
+  bytes exportSectionPayload(bytes_view payload);
+  bytes startSectionPayload(bytes_view payload) const;
+  bytes elementSectionPayload(bytes_view payload);
+  bytes codeSectionPayload(bytes_view payload) const;
+  bytes instrumentBody(bytes_view body) const;
+
+  void emitFlush(bytes& out) const;
+  void emitCheck(bytes& out) const;
+  void emitCharge(bytes& out, uint64_t cost) const;
+
+  bytes_view m_code;
+  vector<Section> m_sections;
+  vector<FunctionType> m_types;
+  vector<uint32_t> m_functionTypes;
+  uint32_t m_numFunctionImports = 0;
+  uint32_t m_numGlobalImports = 0;
+  uint32_t m_numGlobals = 0;
+
+  // Whether the useGas import has to be added (and function indices shifted).
+  bool m_hasUseGasImport = false;
+  bool m_addImport = false;
+  uint32_t m_useGasFunction = 0;
+  uint32_t m_useGasType = 0;
+  uint32_t m_voidType = 0;
+  uint32_t m_counterGlobal = 0;
+  uint32_t m_flushFunction = 0;
+  uint32_t m_mainFunction = 0;
+  uint32_t m_mainWrapperFunction = 0;
+  bool m_hasMain = false;
+  // Whether call_indirect may reach a host function. Known once the element section is rewritten.
+  bool m_tableHoldsImports = false;
+};
+
+void MeteringInjector::readTypes(bytes_view payload)
+{
+  Reader reader{payload};
+  for (uint32_t count = reader.u32(); count > 0; --count) {
+    ensureWellFormed(reader.byte() == typeFunc);
+    FunctionType type;
+    type.params = bytes{reader.take(reader.u32())};
+    type.results = bytes{reader.take(reader.u32())};
+    m_types.push_back(move(type));
+  }
+  ensureWellFormed(reader.done());
+}
+
+void MeteringInjector::readImports(bytes_view payload)
+{
+  Reader reader{payload};
+  for (uint32_t count = reader.u32(); count > 0; --count) {
+    bytes_view module = reader.name();
+    bytes_view field = reader.name();
+    switch (reader.byte()) {
+    case externalFunction: {
+      uint32_t type = reader.u32();
+      if (module == bytes_view{reinterpret_cast<uint8_t const*>("ethereum"), 8} &&
+          field == bytes_view{reinterpret_cast<uint8_t const*>("useGas"), 6}) {
+        ensureCondition(
+          type < m_types.size() && m_types[type] == (FunctionType{bytes{typeI64}, {}}),
+          ContractValidationFailure,
+          "Imported function type mismatch."
+        );
+        m_useGasFunction = m_numFunctionImports;
+        m_hasUseGasImport = true;
+      }
+      m_functionTypes.push_back(type);
+      ++m_numFunctionImports;
+      break;
+    }
+    case externalTable:
+      m_tableHoldsImports = true;
+      reader.byte();
+      reader.skipLimits();
+      break;
+    case externalMemory:
+      reader.skipLimits();
+      break;
+    case externalGlobal:
+      reader.byte();
+      reader.byte();
+      ++m_numGlobalImports;
+      break;
+    default:
+      ensureWellFormed(false);
+    }
+  }
+  ensureWellFormed(reader.done());
+}
+
+void MeteringInjector::readFunctions(bytes_view payload)
+{
+  Reader reader{payload};
+  for (uint32_t count = reader.u32(); count > 0; --count)
+    m_functionTypes.push_back(reader.u32());
+  ensureWellFormed(reader.done());
+}
+
+void MeteringInjector::readGlobals(bytes_view payload)
+{
+  Reader reader{payload};
+  m_numGlobals = reader.u32();
+}
+
+uint32_t MeteringInjector::findOrAddType(FunctionType const& type)
+{
+  for (size_t i = 0; i < m_types.size(); ++i)
+    if (m_types[i] == type)
+      return static_cast<uint32_t>(i);
+  m_types.push_back(type);
+  return static_cast<uint32_t>(m_types.size() - 1);
+}
+
+bytes MeteringInjector::typeSectionPayload() const
+{
+  bytes ret;
+  writeU32(ret, static_cast<uint32_t>(m_types.size()));
+  for (auto const& type: m_types) {
+    ret.push_back(typeFunc);
+    writeU32(ret, static_cast<uint32_t>(type.params.size()));
+    ret += type.params;
+    writeU32(ret, static_cast<uint32_t>(type.results.size()));
+    ret += type.results;
+  }
+  return ret;
+}
+
+bytes MeteringInjector::importSectionPayload(bytes_view payload) const
+{
+  if (!m_addImport)
+    return bytes{payload};
+
+  Reader reader{payload};
+  uint32_t count = payload.empty() ? 0 : reader.u32();
+  bytes ret;
+  writeU32(ret, count + 1);
+  ret += reader.rest();
+  // Function imports are numbered in order, so appending keeps the existing indices.
+  writeU32(ret, 8);
+  ret += reinterpret_cast<uint8_t const*>("ethereum");
+  writeU32(ret, 6);
+  ret += reinterpret_cast<uint8_t const*>("useGas");
+  ret.push_back(externalFunction);
+  writeU32(ret, m_useGasType);
+  return ret;
+}
+
+bytes MeteringInjector::functionSectionPayload(bytes_view payload) const
+{
+  Reader reader{payload};
+  uint32_t count = payload.empty() ? 0 : reader.u32();
+  bytes ret;
+  writeU32(ret, count + 2);
+  ret += reader.rest();
+  // the flush function and the wrapper of "main"
+  writeU32(ret, m_voidType);
+  writeU32(ret, m_voidType);
+  return ret;
+}
+
+bytes MeteringInjector::globalSectionPayload(bytes_view payload) const
+{
+  Reader reader{payload};
+  uint32_t count = payload.empty() ? 0 : reader.u32();
+  bytes ret;
+  writeU32(ret, count + 1);
+  ret += reader.rest();
+  // (global (mut i64) (i64.const 0))
+  ret += bytes{typeI64, 0x01, opI64Const, 0x00, opEnd};
+  return ret;
+}
+
+bytes MeteringInjector::exportSectionPayload(bytes_view payload)
+{
+  Reader reader{payload};
+  bytes ret;
+  uint32_t count = reader.u32();
+  writeU32(ret, count);
+  for (; count > 0; --count) {
+    bytes_view name = reader.name();
+    uint8_t kind = reader.byte();
+    uint32_t index = reader.u32();
+    writeU32(ret, static_cast<uint32_t>(name.size()));
+    ret += name;
+    ret.push_back(kind);
+    if (kind == externalFunction) {
+      if (name == bytes_view{reinterpret_cast<uint8_t const*>("main"), 4}) {
+        ensureWellFormed(index < m_functionTypes.size());
+        ensureCondition(
+          m_types.at(m_functionTypes[index]) == FunctionType{},
+          ContractValidationFailure,
+          "Contract is invalid. \"main\" has an invalid signature."
+        );
+        m_mainFunction = shifted(index);
+        m_hasMain = true;
+        index = m_mainWrapperFunction;
+      } else {
+        index = shifted(index);
+      }
+    }
+    writeU32(ret, index);
+  }
+  ensureWellFormed(reader.done());
+  return ret;
+}
+
+bytes MeteringInjector::startSectionPayload(bytes_view payload) const
+{
+  Reader reader{payload};
+  bytes ret;
+  writeU32(ret, shifted(reader.u32()));
+  ensureWellFormed(reader.done());
+  return ret;
+}
+
+bytes MeteringInjector::elementSectionPayload(bytes_view payload)
+{
+  Reader reader{payload};
+  bytes ret;
+  uint32_t count = reader.u32();
+  writeU32(ret, count);
+  for (; count > 0; --count) {
+    // table index and offset expression are copied
+    size_t start = reader.position();
+    reader.u32();
+    while (readInstruction(reader).opcode != opEnd) {}
+    ret += reader.slice(start);
+
+    uint32_t numFunctions = reader.u32();
+    writeU32(ret, numFunctions);
+    for (; numFunctions > 0; --numFunctions) {
+      uint32_t function = reader.u32();
+      m_tableHoldsImports = m_tableHoldsImports || isImport(function);
+      writeU32(ret, shifted(function));
+    }
+  }
+  ensureWellFormed(reader.done());
+  return ret;
+}
+
+void MeteringInjector::emitFlush(bytes& out) const
+{
+  out.push_back(opCall);
+  writeU32(out, m_flushFunction);
+}
+
+void MeteringInjector::emitCheck(bytes& out) const
+{
+  out.push_back(opGetGlobal);
+  writeU32(out, m_counterGlobal);
+  out.push_back(opI64Const);
+  writeS64(out, static_cast<int64_t>(flushThreshold));
+  out.push_back(opI64GtU);
+  out.push_back(opIf);
+  out.push_back(blockTypeEmpty);
+  emitFlush(out);
+  out.push_back(opEnd);
+}
+
+void MeteringInjector::emitCharge(bytes& out, uint64_t cost) const
+{
+  out.push_back(opGetGlobal);
+  writeU32(out, m_counterGlobal);
+  out.push_back(opI64Const);
+  writeS64(out, static_cast<int64_t>(cost));
+  out.push_back(opI64Add);
+  out.push_back(opSetGlobal);
+  writeU32(out, m_counterGlobal);
+}
+
+bytes MeteringInjector::instrumentBody(bytes_view body) const
+{
+  Reader reader{body};
+  for (uint32_t count = reader.u32(); count > 0; --count) {
+    reader.u32();
+    reader.byte();
+  }
+  size_t codeStart = reader.position();
+
+  // First pass: the cost of every segment, in order.
+  vector<uint64_t> costs;
+  uint64_t cost = 0;
+  while (!reader.done()) {
+    Instruction instruction = readInstruction(reader);
+    cost += instructionCost;
+    if (endsSegment(instruction.opcode)) {
+      costs.push_back(cost);
+      cost = 0;
+    }
+  }
+  // The body has to end with the "end" of the function.
+  ensureWellFormed(cost == 0 && !costs.empty());
+
+  // Second pass: charge each segment when entering it.
+  Reader code{body.substr(codeStart)};
+  bytes ret{body.substr(0, codeStart)};
+  emitCheck(ret);
+  size_t segment = 0;
+  bool segmentStart = true;
+  while (!code.done()) {
+    Instruction instruction = readInstruction(code);
+    if (segmentStart) {
+      emitCharge(ret, costs[segment++]);
+      segmentStart = false;
+    }
+
+    if (instruction.opcode == opCall) {
+      if (isImport(instruction.callee))
+        emitFlush(ret);
+      ret.push_back(opCall);
+      writeU32(ret, shifted(instruction.callee));
+    } else {
+      // A table may contain imported functions too.
+      if (instruction.opcode == opCallIndirect && m_tableHoldsImports)
+        emitFlush(ret);
+      ret += instruction.raw;
+    }
+
+    if (endsSegment(instruction.opcode)) {
+      segmentStart = true;
+      // Bound the gas used without charging it in every iteration.
+      if (instruction.opcode == opLoop)
+        emitCheck(ret);
+    }
+  }
+  return ret;
+}
+
+bytes MeteringInjector::codeSectionPayload(bytes_view payload) const
+{
+  Reader reader{payload};
+  bytes ret;
+  uint32_t count = payload.empty() ? 0 : reader.u32();
+  writeU32(ret, count + 2);
+  for (; count > 0; --count) {
+    bytes body = instrumentBody(reader.take(reader.u32()));
+    writeU32(ret, static_cast<uint32_t>(body.size()));
+    ret += body;
+  }
+  ensureWellFormed(reader.done());
+
+  // The flush function: charges and resets the counter, unless it is zero.
+  bytes flush{0x00};
+  flush.push_back(opGetGlobal);
+  writeU32(flush, m_counterGlobal);
+  flush += bytes{opI64Eqz, opBrIf, 0x00};
+  flush.push_back(opGetGlobal);
+  writeU32(flush, m_counterGlobal);
+  flush.push_back(opCall);
+  writeU32(flush, m_useGasFunction);
+  flush += bytes{opI64Const, 0x00};
+  flush.push_back(opSetGlobal);
+  writeU32(flush, m_counterGlobal);
+  flush.push_back(opEnd);
+  writeU32(ret, static_cast<uint32_t>(flush.size()));
+  ret += flush;
+
+  // The wrapper of "main": charges what is left once it returns.
+  bytes wrapper{0x00};
+  wrapper.push_back(opCall);
+  writeU32(wrapper, m_mainFunction);
+  emitFlush(wrapper);
+  wrapper.push_back(opEnd);
+  writeU32(ret, static_cast<uint32_t>(wrapper.size()));
+  ret += wrapper;
+  return ret;
+}
+
+bytes MeteringInjector::run()
+{
+  m_sections = readSections(m_code);
+
+  bool present[dataSection + 1] = {};
+  uint8_t lastId = customSection;
+  bytes_view exports;
+  for (auto const& section: m_sections) {
+    if (section.id == customSection)
+      continue;
+    // The order matters, the element section is rewritten before the code section.
+    ensureWellFormed(section.id > lastId);
+    lastId = section.id;
+    present[section.id] = true;
+    switch (section.id) {
+    case typeSection:
+      readTypes(section.payload);
+      break;
+    case importSection:
+      readImports(section.payload);
+      break;
+    case functionSection:
+      readFunctions(section.payload);
+      break;
+    case globalSection:
+      readGlobals(section.payload);
+      break;
+    case exportSection:
+      exports = section.payload;
+      break;
+    default:
+      break;
+    }
+  }
+  ensureCondition(present[exportSection], ContractValidationFailure, "\"main\" not found");
+
+  m_useGasType = findOrAddType(FunctionType{bytes{typeI64}, {}});
+  m_voidType = findOrAddType(FunctionType{});
+  m_addImport = !m_hasUseGasImport;
+  if (m_addImport)
+    m_useGasFunction = m_numFunctionImports;
+  uint32_t numFunctions = static_cast<uint32_t>(m_functionTypes.size()) + (m_addImport ? 1 : 0);
+  m_flushFunction = numFunctions;
+  m_mainWrapperFunction = numFunctions + 1;
+  m_counterGlobal = m_numGlobalImports + m_numGlobals;
+
+  // The code needs the index of "main", so the exports are rewritten first.
+  bytes exportPayload = exportSectionPayload(exports);
+  ensureCondition(m_hasMain, ContractValidationFailure, "\"main\" not found");
+
+  bytes ret{m_code.substr(0, 8)};
+  bool created[dataSection + 1] = {};
+  // Adds the sections which are needed but missing and precede @id.
+  auto createMissingSections = [&](uint8_t id) {
+    for (uint8_t missing: {typeSection, importSection, functionSection, globalSection, codeSection}) {
+      if (missing >= id || present[missing] || created[missing] || (missing == importSection && !m_addImport))
+        continue;
+      created[missing] = true;
+      switch (missing) {
+      case typeSection: writeSection(ret, missing, typeSectionPayload()); break;
+      case importSection: writeSection(ret, missing, importSectionPayload({})); break;
+      case functionSection: writeSection(ret, missing, functionSectionPayload({})); break;
+      case globalSection: writeSection(ret, missing, globalSectionPayload({})); break;
+      case codeSection: writeSection(ret, missing, codeSectionPayload({})); break;
+      }
+    }
+  };
+
+  for (auto const& section: m_sections) {
+    if (section.id == customSection) {
+      // The name section refers to function indices, which are changed.
+      if (Reader{section.payload}.name() != bytes_view{reinterpret_cast<uint8_t const*>("name"), 4})
+        writeSection(ret, customSection, bytes{section.payload});
+      continue;
+    }
+
+    createMissingSections(section.id);
+    switch (section.id) {
+    case typeSection: writeSection(ret, section.id, typeSectionPayload()); break;
+    case importSection: writeSection(ret, section.id, importSectionPayload(section.payload)); break;
+    case functionSection: writeSection(ret, section.id, functionSectionPayload(section.payload)); break;
+    case globalSection: writeSection(ret, section.id, globalSectionPayload(section.payload)); break;
+    case exportSection: writeSection(ret, section.id, exportPayload); break;
+    case startSection: writeSection(ret, section.id, startSectionPayload(section.payload)); break;
+    case elementSection: writeSection(ret, section.id, elementSectionPayload(section.payload)); break;
+    case codeSection: writeSection(ret, section.id, codeSectionPayload(section.payload)); break;
+    default: writeSection(ret, section.id, bytes{section.payload}); break;
+    }
+  }
+  createMissingSections(dataSection + 1);
+  return ret;
+}
+
+class MemoryLimitInjector {
+public:
+  MemoryLimitInjector(bytes_view code, uint64_t pages): m_code(code), m_pages(pages) {}
+
+  bytes run();
+
+private:
+  void readImports(bytes_view payload);
+  bytes globalSectionPayload(bytes_view payload) const;
+  bytes codeSectionPayload(bytes_view payload);
+  bytes instrumentBody(bytes_view body);
+
+  void emitGuard(bytes& out) const;
+
+  bytes_view m_code;
+  uint64_t const m_pages;
+  uint32_t m_numGlobalImports = 0;
+  uint32_t m_numGlobals = 0;
+  uint32_t m_deltaGlobal = 0;
+  bool m_hasGrowMemory = false;
+};
+
+void MemoryLimitInjector::readImports(bytes_view payload)
+{
+  Reader reader{payload};
+  for (uint32_t count = reader.u32(); count > 0; --count) {
+    reader.name();
+    reader.name();
+    switch (reader.byte()) {
+    case externalFunction:
+      reader.u32();
+      break;
+    case externalTable:
+      reader.byte();
+      reader.skipLimits();
+      break;
+    case externalMemory:
+      reader.skipLimits();
+      break;
+    case externalGlobal:
+      reader.byte();
+      reader.byte();
+      ++m_numGlobalImports;
+      break;
+    default:
+      ensureWellFormed(false);
+    }
+  }
+  ensureWellFormed(reader.done());
+}
+
+bytes MemoryLimitInjector::globalSectionPayload(bytes_view payload) const
+{
+  Reader reader{payload};
+  uint32_t count = payload.empty() ? 0 : reader.u32();
+  bytes ret;
+  writeU32(ret, count + 1);
+  ret += reader.rest();
+  // (global (mut i32) (i32.const 0))
+  ret += bytes{typeI32, 0x01, opI32Const, 0x00, opEnd};
+  return ret;
+}
+
+// Traps unless the memory stays within the limit, with the operand of memory.grow stashed in
+// the global while checking it.
+void MemoryLimitInjector::emitGuard(bytes& out) const
+{
+  out.push_back(opSetGlobal);
+  writeU32(out, m_deltaGlobal);
+  out += bytes{opCurrentMemory, 0x00, opI64ExtendUI32};
+  out.push_back(opGetGlobal);
+  writeU32(out, m_deltaGlobal);
+  out += bytes{opI64ExtendUI32, opI64Add};
+  out.push_back(opI64Const);
+  writeS64(out, static_cast<int64_t>(m_pages));
+  out += bytes{opI64GtU, opIf, blockTypeEmpty, opUnreachable, opEnd};
+  out.push_back(opGetGlobal);
+  writeU32(out, m_deltaGlobal);
+}
+
+bytes MemoryLimitInjector::instrumentBody(bytes_view body)
+{
+  Reader reader{body};
+  for (uint32_t count = reader.u32(); count > 0; --count) {
+    reader.u32();
+    reader.byte();
+  }
+  bytes ret{reader.slice(0)};
+  while (!reader.done()) {
+    Instruction instruction = readInstruction(reader);
+    if (instruction.opcode == opGrowMemory) {
+      emitGuard(ret);
+      m_hasGrowMemory = true;
+    }
+    ret += instruction.raw;
+  }
+  return ret;
+}
+
+bytes MemoryLimitInjector::codeSectionPayload(bytes_view payload)
+{
+  Reader reader{payload};
+  bytes ret;
+  uint32_t count = reader.u32();
+  writeU32(ret, count);
+  for (; count > 0; --count) {
+    bytes body = instrumentBody(reader.take(reader.u32()));
+    writeU32(ret, static_cast<uint32_t>(body.size()));
+    ret += body;
+  }
+  ensureWellFormed(reader.done());
+  return ret;
+}
+
+bytes MemoryLimitInjector::run()
+{
+  vector<Section> sections = readSections(m_code);
+  bool hasGlobals = false;
+  bytes code;
+  for (auto const& section: sections) {
+    if (section.id == importSection) {
+      readImports(section.payload);
+    } else if (section.id == globalSection) {
+      m_numGlobals = Reader{section.payload}.u32();
+      hasGlobals = true;
+    }
+  }
+  m_deltaGlobal = m_numGlobalImports + m_numGlobals;
+  for (auto const& section: sections)
+    if (section.id == codeSection)
+      code = codeSectionPayload(section.payload);
+  // Without memory.grow the memory cannot exceed its initial size, which the engines check.
+  if (!m_hasGrowMemory)
+    return bytes{m_code};
+
+  bytes ret{m_code.substr(0, 8)};
+  bool addedGlobals = hasGlobals;
+  for (auto const& section: sections) {
+    if (!addedGlobals && section.id > globalSection) {
+      writeSection(ret, globalSection, globalSectionPayload({}));
+      addedGlobals = true;
+    }
+    switch (section.id) {
+    case globalSection: writeSection(ret, section.id, globalSectionPayload(section.payload)); break;
+    case codeSection: writeSection(ret, section.id, code); break;
+    default: writeSection(ret, section.id, bytes{section.payload}); break;
+    }
+  }
+  return ret;
+}
+
+}
+
+bytes injectNativeMetering(bytes_view code)
+{
+  return MeteringInjector{code}.run();
+}
+
+bytes injectMemoryLimit(bytes_view code, uint64_t pages)
+{
+  // No memory can grow beyond it anyway.
+  if (pages >= maxWasmPages)
+    return bytes{code};
+  return MemoryLimitInjector{code, pages}.run();
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "helpers.h"
+
+namespace hera {
+
+/// Instruments a WebAssembly binary with gas metering, as an alternative to the sentinel contract.
+///
+/// Every straight-line segment of code adds its cost (one per instruction) to a private i64
+/// global. The accumulated gas is charged through `ethereum.useGas` only at loop headers and
+/// function entries once it exceeds a threshold, before calling any import (so every host
+/// function sees the exact gas left) and after "main" returns. Compared to a `useGas` call per
+/// block this keeps the metering inline, at the price of running out of gas up to the threshold
+/// later (but never after a side effect).
+///
+/// The name section is dropped, as function indices change. Throws ContractValidationFailure on
+/// malformed or unsupported input.
+bytes injectNativeMetering(bytes_view code);
+
+/// Guards every memory.grow of a WebAssembly binary to trap if the memory would exceed @pages,
+/// the "memory-limit" option, so the limit is kept the same way by every engine. The operand
+/// is checked in an i32 global appended for this. Code without memory.grow is returned as it is.
+///
+/// Throws ContractValidationFailure on malformed or unsupported input.
+bytes injectMemoryLimit(bytes_view code, uint64_t pages);
+
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "metrics.h"
+
+using namespace std;
+
+namespace hera {
+
+atomic<bool> metricsEnabledFlag{false};
+
+namespace {
+
+constexpr char const* hostFunctionNames[] = {
+  "useGas",
+  "getGasLeft",
+  "getAddress",
+  "getExternalBalance",
+  "getBlockHash",
+  "getCallDataSize",
+  "callDataCopy",
+  "getCaller",
+  "getCallValue",
+  "codeCopy",
+  "getCodeSize",
+  "externalCodeCopy",
+  "getExternalCodeSize",
+  "getBlockCoinbase",
+  "getBlockDifficulty",
+  "getBlockGasLimit",
+  "getTxGasPrice",
+  "log",
+  "getBlockNumber",
+  "getBlockTimestamp",
+  "getTxOrigin",
+  "storageStore",
+  "storageLoad",
+  "finish",
+  "revert",
+  "getReturnDataSize",
+  "returnDataCopy",
+  "call",
+  "callCode",
+  "callDelegate",
+  "callStatic",
+  "create",
+  "selfDestruct",
+};
+static_assert(sizeof(hostFunctionNames) / sizeof(hostFunctionNames[0]) == numHostFunctions, "Missing host function name.");
+
+constexpr char const* phaseNames[] = {
+  "parse",
+  "validate",
+  "compile",
+  "instantiate",
+  "execute",
+};
+static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == numPhases, "Missing phase name.");
+
+// Upper bounds of the latency histogram buckets in nanoseconds, the last bucket is unbounded.
+constexpr uint64_t bucketBounds[] = {
+  1000, 4000, 16000, 64000, 256000, 1024000, 4096000, 16384000, 65536000, 262144000
+};
+constexpr size_t numBuckets = sizeof(bucketBounds) / sizeof(bucketBounds[0]) + 1;
+
+// Only the owning thread writes a counter, so the increments need no atomic
+// read-modify-write, the atomics merely make concurrent dumps well-defined.
+void increment(atomic<uint64_t>& counter, uint64_t value) noexcept
+{
+  counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+struct Counter {
+  atomic<uint64_t> count{0};
+  atomic<uint64_t> nanoseconds{0};
+  atomic<uint64_t> gas{0};
+  array<atomic<uint64_t>, numBuckets> buckets{};
+
+  void record(MetricsClock::duration duration, uint64_t gasCharged) noexcept
+  {
+    auto ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(duration).count());
+    size_t bucket = 0;
+    while (bucket < numBuckets - 1 && ns > bucketBounds[bucket])
+      ++bucket;
+    increment(count, 1);
+    increment(nanoseconds, ns);
+    increment(gas, gasCharged);
+    increment(buckets[bucket], 1);
+  }
+};
+
+struct MemoryCounter {
+  atomic<uint64_t> reservations{0};
+  atomic<uint64_t> pages{0};
+  atomic<uint64_t> rejections{0};
+};
+
+struct Slot {
+  array<Counter, numHostFunctions> hostFunctions;
+  array<Counter, numPhases> phases;
+  MemoryCounter memory;
+};
+
+// A plain copy of a Counter, summed up over all slots.
+struct Totals {
+  uint64_t count = 0;
+  uint64_t nanoseconds = 0;
+  uint64_t gas = 0;
+  array<uint64_t, numBuckets> buckets{};
+
+  void add(Counter const& counter) noexcept
+  {
+    count += counter.count.load(memory_order_relaxed);
+    nanoseconds += counter.nanoseconds.load(memory_order_relaxed);
+    gas += counter.gas.load(memory_order_relaxed);
+    for (size_t i = 0; i < numBuckets; ++i)
+      buckets[i] += counter.buckets[i].load(memory_order_relaxed);
+  }
+};
+
+struct MemoryTotals {
+  uint64_t reservations = 0;
+  uint64_t pages = 0;
+  uint64_t rejections = 0;
+
+  void add(MemoryCounter const& counter) noexcept
+  {
+    reservations += counter.reservations.load(memory_order_relaxed);
+    pages += counter.pages.load(memory_order_relaxed);
+    rejections += counter.rejections.load(memory_order_relaxed);
+  }
+};
+
+// Slots outlive their threads, so nothing recorded is lost. Their number is
+// bounded by the number of threads which ever executed with metrics enabled.
+mutex slotsMutex;
+vector<unique_ptr<Slot>> slots;
+
+Slot& localSlot()
+{
+  thread_local Slot* slot = nullptr;
+  if (!slot) {
+    lock_guard<mutex> lock{slotsMutex};
+    slots.push_back(make_unique<Slot>());
+    slot = slots.back().get();
+  }
+  return *slot;
+}
+
+void collectTotals(array<Totals, numHostFunctions>& hostFunctions, array<Totals, numPhases>& phases, MemoryTotals& memory)
+{
+  lock_guard<mutex> lock{slotsMutex};
+  for (auto const& slot: slots) {
+    for (size_t i = 0; i < numHostFunctions; ++i)
+      hostFunctions[i].add(slot->hostFunctions[i]);
+    for (size_t i = 0; i < numPhases; ++i)
+      phases[i].add(slot->phases[i]);
+    memory.add(slot->memory);
+  }
+}
+
+double seconds(uint64_t nanoseconds) noexcept
+{
+  return static_cast<double>(nanoseconds) / 1e9;
+}
+
+void writeJson(ostream& out, Totals const& totals, bool withGas)
+{
+  out << "{\"count\":" << totals.count << ",\"nanoseconds\":" << totals.nanoseconds;
+  if (withGas)
+    out << ",\"gas\":" << totals.gas;
+  out << ",\"histogram\":[";
+  for (size_t i = 0; i < numBuckets; ++i)
+    out << (i ? "," : "") << totals.buckets[i];
+  out << "]}";
+}
+
+void writePrometheusHistogram(ostream& out, char const* metric, char const* label, char const* value, Totals const& totals)
+{
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < numBuckets; ++i) {
+    cumulative += totals.buckets[i];
+    out << metric << "_bucket{" << label << "=\"" << value << "\",le=\"";
+    if (i < numBuckets - 1)
+      out << seconds(bucketBounds[i]);
+    else
+      out << "+Inf";
+    out << "\"} " << cumulative << "\n";
+  }
+  out << metric << "_sum{" << label << "=\"" << value << "\"} " << seconds(totals.nanoseconds) << "\n";
+  out << metric << "_count{" << label << "=\"" << value << "\"} " << totals.count << "\n";
+}
+
+}
+
+void enableMetrics() noexcept
+{
+  metricsEnabledFlag.store(true, memory_order_relaxed);
+}
+
+void recordHostFunction(HostFunction function, MetricsClock::duration duration, int64_t gas) noexcept
+{
+  try {
+    // The gas left may grow, e.g. by the refund of a call.
+    localSlot().hostFunctions[static_cast<size_t>(function)].record(duration, gas > 0 ? static_cast<uint64_t>(gas) : 0);
+  } catch (...) {
+    // Allocating the slot failed, the call is not counted.
+  }
+}
+
+void recordPhase(Phase phase, MetricsClock::duration duration) noexcept
+{
+  try {
+    localSlot().phases[static_cast<size_t>(phase)].record(duration, 0);
+  } catch (...) {
+    // Allocating the slot failed, the phase is not counted.
+  }
+}
+
+void recordMemoryReservation(uint64_t pages, bool accepted) noexcept
+{
+  if (!metricsEnabled())
+    return;
+  try {
+    MemoryCounter& memory = localSlot().memory;
+    if (accepted) {
+      increment(memory.reservations, 1);
+      increment(memory.pages, pages);
+    } else {
+      increment(memory.rejections, 1);
+    }
+  } catch (...) {
+    // Allocating the slot failed, the reservation is not counted.
+  }
+}
+
+string dumpMetrics(MetricsFormat format)
+{
+  array<Totals, numHostFunctions> hostFunctions;
+  array<Totals, numPhases> phases;
+  MemoryTotals memory;
+  collectTotals(hostFunctions, phases, memory);
+
+  ostringstream out;
+  if (format == MetricsFormat::json) {
+    out << "{\"histogramBounds\":[";
+    for (size_t i = 0; i < numBuckets - 1; ++i)
+      out << (i ? "," : "") << bucketBounds[i];
+    out << "],\"hostFunctions\":{";
+    for (size_t i = 0; i < numHostFunctions; ++i) {
+      out << (i ? "," : "") << "\"" << hostFunctionNames[i] << "\":";
+      writeJson(out, hostFunctions[i], true);
+    }
+    out << "},\"phases\":{";
+    for (size_t i = 0; i < numPhases; ++i) {
+      out << (i ? "," : "") << "\"" << phaseNames[i] << "\":";
+      writeJson(out, phases[i], false);
+    }
+    out << "},\"memory\":{\"reservations\":" << memory.reservations << ",\"reservedPages\":" << memory.pages
+        << ",\"rejections\":" << memory.rejections << "}}\n";
+    return out.str();
+  }
+
+  out << setprecision(9);
+  out << "# HELP hera_host_function_gas_total Gas charged by host functions.\n";
+  out << "# TYPE hera_host_function_gas_total counter\n";
+  for (size_t i = 0; i < numHostFunctions; ++i)
+    out << "hera_host_function_gas_total{function=\"" << hostFunctionNames[i] << "\"} " << hostFunctions[i].gas << "\n";
+  out << "# HELP hera_host_function_duration_seconds Duration of host function calls.\n";
+  out << "# TYPE hera_host_function_duration_seconds histogram\n";
+  for (size_t i = 0; i < numHostFunctions; ++i)
+    writePrometheusHistogram(out, "hera_host_function_duration_seconds", "function", hostFunctionNames[i], hostFunctions[i]);
+  out << "# HELP hera_phase_duration_seconds Duration of the phases of executions.\n";
+  out << "# TYPE hera_phase_duration_seconds histogram\n";
+  for (size_t i = 0; i < numPhases; ++i)
+    writePrometheusHistogram(out, "hera_phase_duration_seconds", "phase", phaseNames[i], phases[i]);
+  out << "# HELP hera_memory_reserved_pages_total Memory pages reserved by executions.\n";
+  out << "# TYPE hera_memory_reserved_pages_total counter\n";
+  out << "hera_memory_reserved_pages_total " << memory.pages << "\n";
+  out << "# HELP hera_memory_reservations_total Executions which reserved memory.\n";
+  out << "# TYPE hera_memory_reservations_total counter\n";
+  out << "hera_memory_reservations_total " << memory.reservations << "\n";
+  out << "# HELP hera_memory_rejections_total Executions rejected as the memory budget was used up.\n";
+  out << "# TYPE hera_memory_rejections_total counter\n";
+  out << "hera_memory_rejections_total " << memory.rejections << "\n";
+  return out.str();
+}
+
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace hera {
+
+// Counters of host function calls and execution phases, kept per thread and summed up
+// when dumped. They are process-wide and disabled by default (see the "metrics" option).
+
+enum class HostFunction : unsigned {
+  useGas,
+  getGasLeft,
+  getAddress,
+  getExternalBalance,
+  getBlockHash,
+  getCallDataSize,
+  callDataCopy,
+  getCaller,
+  getCallValue,
+  codeCopy,
+  getCodeSize,
+  externalCodeCopy,
+  getExternalCodeSize,
+  getBlockCoinbase,
+  getBlockDifficulty,
+  getBlockGasLimit,
+  getTxGasPrice,
+  log,
+  getBlockNumber,
+  getBlockTimestamp,
+  getTxOrigin,
+  storageStore,
+  storageLoad,
+  finish,
+  revert,
+  getReturnDataSize,
+  returnDataCopy,
+  call,
+  callCode,
+  callDelegate,
+  callStatic,
+  create,
+  selfDestruct,
+};
+
+constexpr size_t numHostFunctions = static_cast<size_t>(HostFunction::selfDestruct) + 1;
+
+// Engines only report the phases they have, e.g. WABT does not compile.
+// Nested calls are part of the execute phase (and host function call) of their caller.
+enum class Phase : unsigned {
+  parse,
+  validate,
+  compile,
+  instantiate,
+  execute,
+};
+
+constexpr size_t numPhases = static_cast<size_t>(Phase::execute) + 1;
+
+enum class MetricsFormat {
+  json,
+  prometheus,
+};
+
+using MetricsClock = std::chrono::steady_clock;
+
+extern std::atomic<bool> metricsEnabledFlag;
+
+inline bool metricsEnabled() noexcept { return metricsEnabledFlag.load(std::memory_order_relaxed); }
+
+void enableMetrics() noexcept;
+
+void recordHostFunction(HostFunction function, MetricsClock::duration duration, int64_t gas) noexcept;
+void recordPhase(Phase phase, MetricsClock::duration duration) noexcept;
+
+/// Counts the memory reserved by an execution (see MemoryReservation), or the rejection of the execution.
+void recordMemoryReservation(uint64_t pages, bool accepted) noexcept;
+
+/// Returns the counters summed up over all threads.
+std::string dumpMetrics(MetricsFormat format);
+
+/// Records the duration of a host function call and the gas it charged, taken from
+/// the gas counter of the execution.
+class HostFunctionTimer {
+public:
+  HostFunctionTimer(HostFunction function, int64_t const& gasLeft) noexcept:
+    m_function(function), m_gasLeft(gasLeft), m_gasLeftBefore(gasLeft), m_enabled(metricsEnabled())
+  {
+    if (m_enabled)
+      m_start = MetricsClock::now();
+  }
+
+  ~HostFunctionTimer() noexcept
+  {
+    if (m_enabled)
+      recordHostFunction(m_function, MetricsClock::now() - m_start, m_gasLeftBefore - m_gasLeft);
+  }
+
+  HostFunctionTimer(HostFunctionTimer const&) = delete;
+  HostFunctionTimer& operator=(HostFunctionTimer const&) = delete;
+
+private:
+  HostFunction m_function;
+  int64_t const& m_gasLeft;
+  int64_t m_gasLeftBefore;
+  bool m_enabled;
+  MetricsClock::time_point m_start;
+};
+
+/// Records consecutive phases: each start() ends the previous phase, as does
+/// stop() or leaving the scope (also by an exception).
+class PhaseTimer {
+public:
+  PhaseTimer() noexcept: m_enabled(metricsEnabled()) {}
+  ~PhaseTimer() noexcept { stop(); }
+
+  PhaseTimer(PhaseTimer const&) = delete;
+  PhaseTimer& operator=(PhaseTimer const&) = delete;
+
+  void start(Phase phase) noexcept
+  {
+    if (!m_enabled)
+      return;
+    auto now = MetricsClock::now();
+    if (m_running)
+      recordPhase(m_phase, now - m_start);
+    m_phase = phase;
+    m_start = now;
+    m_running = true;
+  }
+
+  void stop() noexcept
+  {
+    if (m_running)
+      recordPhase(m_phase, MetricsClock::now() - m_start);
+    m_running = false;
+  }
+
+private:
+  bool m_enabled;
+  bool m_running = false;
+  Phase m_phase = Phase::parse;
+  MetricsClock::time_point m_start;
+};
+
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
+#include "eei_table.h"
+#include "exceptions.h"
+#include "memory_budget.h"
+#include "module_scanner.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// The sections of WebAssembly 1.0, in the order they have to appear (but custom ones).
+enum SectionId : uint8_t {
+  customSection = 0,
+  typeSection = 1,
+  importSection = 2,
+  functionSection = 3,
+  tableSection = 4,
+  memorySection = 5,
+  globalSection = 6,
+  exportSection = 7,
+  startSection = 8,
+  elementSection = 9,
+  codeSection = 10,
+  dataSection = 11,
+};
+
+enum ExternalKind : uint8_t {
+  functionKind = 0,
+  tableKind = 1,
+  memoryKind = 2,
+  globalKind = 3,
+};
+
+// Reads the contents of a section, which the module is invalid if it runs out of.
+class SectionReader {
+public:
+  explicit SectionReader(bytes_view data) noexcept: m_data(data) {}
+
+  bool done() const noexcept { return m_position == m_data.size(); }
+
+  uint8_t byte()
+  {
+    ensureCondition(m_position < m_data.size(), ContractValidationFailure, "Section is truncated.");
+    return m_data[m_position++];
+  }
+
+  // An unsigned LEB128 number of at most 32 bits.
+  uint32_t u32()
+  {
+    uint32_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      uint8_t b = byte();
+      ensureCondition(shift < 28 || (b & 0xf0) == 0, ContractValidationFailure, "Integer is too large.");
+      value |= uint32_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return value;
+    }
+  }
+
+  string_view name()
+  {
+    uint32_t length = u32();
+    ensureCondition(length <= m_data.size() - m_position, ContractValidationFailure, "Section is truncated.");
+    string_view ret{reinterpret_cast<char const*>(m_data.data() + m_position), length};
+    m_position += length;
+    return ret;
+  }
+
+  // Returns the maximum of the limits, if any.
+  optional<uint32_t> limits()
+  {
+    uint8_t flags = byte();
+    ensureCondition(flags <= 1, ContractValidationFailure, "Invalid limits.");
+    u32();
+    if (flags == 1)
+      return u32();
+    return nullopt;
+  }
+
+  void valueTypes(vector<uint8_t>& types)
+  {
+    uint32_t count = u32();
+    for (uint32_t i = 0; i < count; ++i) {
+      uint8_t type = byte();
+      // i32, i64, f32 and f64
+      ensureCondition(type >= 0x7c && type <= 0x7f, ContractValidationFailure, "Invalid value type.");
+      types.push_back(type);
+    }
+  }
+
+  // Reads the number of entries of a section, each taking at least @entrySize bytes.
+  uint32_t count(size_t entrySize)
+  {
+    uint32_t ret = u32();
+    ensureCondition(ret <= (m_data.size() - m_position) / entrySize, ContractValidationFailure, "Section is truncated.");
+    return ret;
+  }
+
+  void ensureDone() const
+  {
+    ensureCondition(done(), ContractValidationFailure, "Section size mismatch.");
+  }
+
+private:
+  bytes_view m_data;
+  size_t m_position = 0;
+};
+
+uint8_t wasmType(EEIValueType type) noexcept
+{
+  return (type == EEIValueType::i64) ? 0x7e : 0x7f;
+}
+
+template <typename FunctionType>
+bool hasEEIType(FunctionType const& type, EEIFunction const& function) noexcept
+{
+  if (type.params.size() != function.paramCount)
+    return false;
+  for (size_t i = 0; i < function.paramCount; ++i)
+    if (type.params[i] != wasmType(function.params[i]))
+      return false;
+  if (function.result == EEIValueType::none)
+    return type.results.empty();
+  return type.results.size() == 1 && type.results[0] == wasmType(function.result);
+}
+
+}
+
+void ModuleScanner::feed(bytes_view chunk)
+{
+  if (m_hashing)
+    m_hash.update(chunk);
+
+  while (!chunk.empty()) {
+    switch (m_state) {
+    case State::preamble: {
+      bytes_view preamble;
+      if (!take(chunk, 8, preamble))
+        return;
+      ensureCondition(hasWasmPreamble(preamble) && hasWasmVersion(preamble, 1), ContractValidationFailure, "Contract is not WebAssembly version 1.");
+      m_pending.clear();
+      m_state = State::sectionId;
+      break;
+    }
+    case State::sectionId:
+      m_sectionId = chunk[0];
+      chunk.remove_prefix(1);
+      ensureCondition(m_sectionId <= dataSection, ContractValidationFailure, "Unknown section.");
+      ensureCondition(m_sectionId != startSection, ContractValidationFailure, "Contract contains start function.");
+      if (m_sectionId != customSection) {
+        ensureCondition(m_sectionId > m_lastSectionId, ContractValidationFailure, "Sections are out of order.");
+        m_lastSectionId = m_sectionId;
+      }
+      m_sectionSize = 0;
+      m_sectionSizeShift = 0;
+      m_state = State::sectionSize;
+      break;
+    case State::sectionSize: {
+      uint8_t b = chunk[0];
+      chunk.remove_prefix(1);
+      ensureCondition(m_sectionSizeShift < 28 || (b & 0xf0) == 0, ContractValidationFailure, "Section is too large.");
+      m_sectionSize |= uint32_t(b & 0x7f) << m_sectionSizeShift;
+      m_sectionSizeShift += 7;
+      if (b & 0x80)
+        break;
+
+      // Only the sections the imports and exports depend on are looked into.
+      switch (m_sectionId) {
+      case typeSection:
+      case importSection:
+      case functionSection:
+      case memorySection:
+      case exportSection:
+        m_state = State::sectionBody;
+        break;
+      default:
+        m_skipped = m_sectionSize;
+        m_state = State::skip;
+        break;
+      }
+      // An empty section ends here, even if it is the last bytes fed.
+      if (m_sectionSize == 0) {
+        if (m_state == State::sectionBody)
+          scanSection(m_sectionId, {});
+        m_state = State::sectionId;
+      }
+      break;
+    }
+    case State::sectionBody: {
+      bytes_view body;
+      if (!take(chunk, m_sectionSize, body))
+        return;
+      scanSection(m_sectionId, body);
+      m_pending.clear();
+      m_state = State::sectionId;
+      break;
+    }
+    case State::skip: {
+      size_t length = min<size_t>(m_skipped, chunk.size());
+      chunk.remove_prefix(length);
+      m_skipped -= static_cast<uint32_t>(length);
+      if (m_skipped == 0)
+        m_state = State::sectionId;
+      break;
+    }
+    }
+  }
+}
+
+evmc::bytes32 ModuleScanner::finish()
+{
+  ensureCondition(m_state == State::sectionId, ContractValidationFailure, "Module is truncated.");
+  ensureCondition(m_mainExported, ContractValidationFailure, "Contract entry point (\"main\") missing.");
+  ensureCondition(m_memoryExported, ContractValidationFailure, "Contract export (\"memory\") missing.");
+  return m_hashing ? m_hash.finish() : evmc::bytes32{};
+}
+
+bool ModuleScanner::take(bytes_view& chunk, size_t length, bytes_view& unit)
+{
+  if (m_pending.empty() && chunk.size() >= length) {
+    unit = chunk.substr(0, length);
+    chunk.remove_prefix(length);
+    return true;
+  }
+
+  size_t missing = min(length - m_pending.size(), chunk.size());
+  m_pending.append(chunk.data(), missing);
+  chunk.remove_prefix(missing);
+  if (m_pending.size() < length)
+    return false;
+  unit = m_pending;
+  return true;
+}
+
+void ModuleScanner::scanSection(uint8_t id, bytes_view body)
+{
+  switch (id) {
+  case typeSection:
+    scanTypes(body);
+    break;
+  case importSection:
+    scanImports(body);
+    break;
+  case functionSection:
+    scanFunctions(body);
+    break;
+  case memorySection:
+    scanMemories(body);
+    break;
+  case exportSection:
+    scanExports(body);
+    break;
+  default:
+    heraAssert(false, "Section is not scanned.");
+  }
+}
+
+void ModuleScanner::scanTypes(bytes_view body)
+{
+  SectionReader reader{body};
+  uint32_t count = reader.count(3);
+  m_types.resize(count);
+  for (FunctionType& type: m_types) {
+    ensureCondition(reader.byte() == 0x60, ContractValidationFailure, "Invalid function type.");
+    reader.valueTypes(type.params);
+    reader.valueTypes(type.results);
+  }
+  reader.ensureDone();
+}
+
+void ModuleScanner::scanImports(bytes_view body)
+{
+  SectionReader reader{body};
+  uint32_t count = reader.count(4);
+  for (uint32_t i = 0; i < count; ++i) {
+    string_view moduleName = reader.name();
+    string_view fieldName = reader.name();
+    uint8_t kind = reader.byte();
+
+#if HERA_DEBUGGING
+    if (moduleName == "debug") {
+      switch (kind) {
+      case functionKind:
+        reader.u32();
+        ++m_importedFunctions;
+        break;
+      case tableKind:
+        reader.byte();
+        reader.limits();
+        break;
+      case memoryKind:
+        m_memoryMaximum = reader.limits();
+        ++m_memories;
+        break;
+      case globalKind:
+        reader.byte();
+        reader.byte();
+        break;
+      default:
+        ensureCondition(false, ContractValidationFailure, "Invalid import kind.");
+      }
+      continue;
+    }
+#endif
+
+    ensureCondition(moduleName == "ethereum", ContractValidationFailure, "Import from invalid namespace.");
+    EEIFunction const* function = findEEIFunction(fieldName);
+    ensureCondition(function, ContractValidationFailure, "Importing invalid EEI method.");
+    ensureCondition(kind == functionKind, ContractValidationFailure, "Imported function type mismatch.");
+    uint32_t typeIndex = reader.u32();
+    ensureCondition(typeIndex < m_types.size(), ContractValidationFailure, "Import function type is missing.");
+    ensureCondition(hasEEIType(m_types[typeIndex], *function), ContractValidationFailure, "Imported function type mismatch.");
+    ++m_importedFunctions;
+  }
+  reader.ensureDone();
+}
+
+void ModuleScanner::scanFunctions(bytes_view body)
+{
+  SectionReader reader{body};
+  uint32_t count = reader.count(1);
+  m_functionTypes.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t typeIndex = reader.u32();
+    ensureCondition(typeIndex < m_types.size(), ContractValidationFailure, "Function type is missing.");
+    m_functionTypes.push_back(typeIndex);
+  }
+  reader.ensureDone();
+}
+
+void ModuleScanner::scanMemories(bytes_view body)
+{
+  SectionReader reader{body};
+  uint32_t count = reader.count(2);
+  m_memories += count;
+  ensureCondition(m_memories <= 1, ContractValidationFailure, "Multiple memory sections exported.");
+  for (uint32_t i = 0; i < count; ++i)
+    m_memoryMaximum = reader.limits();
+  reader.ensureDone();
+}
+
+void ModuleScanner::scanExports(bytes_view body)
+{
+  SectionReader reader{body};
+  uint32_t count = reader.count(3);
+  for (uint32_t i = 0; i < count; ++i) {
+    string_view name = reader.name();
+    uint8_t kind = reader.byte();
+    uint32_t index = reader.u32();
+
+    if (name == "main") {
+      ensureCondition(!m_mainExported, ContractValidationFailure, "Duplicate export.");
+      ensureCondition(kind == functionKind, ContractValidationFailure, "\"main\" is not pointing to function.");
+      // Imported functions come first in the index space.
+      ensureCondition(
+        index >= m_importedFunctions && index - m_importedFunctions < m_functionTypes.size(),
+        ContractValidationFailure,
+        "Contract is invalid. \"main\" is not a function."
+      );
+      FunctionType const& type = m_types[m_functionTypes[index - m_importedFunctions]];
+      ensureCondition(
+        type.params.empty() && type.results.empty(),
+        ContractValidationFailure,
+        "Contract is invalid. \"main\" has an invalid signature."
+      );
+      m_mainExported = true;
+    } else if (name == "memory") {
+      ensureCondition(!m_memoryExported, ContractValidationFailure, "Duplicate export.");
+      ensureCondition(kind == memoryKind && index < m_memories, ContractValidationFailure, "\"memory\" is not pointing to memory.");
+      m_memoryExported = true;
+    } else {
+      ensureCondition(false, ContractValidationFailure, "Invalid export is present.");
+    }
+  }
+  reader.ensureDone();
+}
+
+uint64_t declaredMemoryMaximum(bytes_view code) noexcept
+{
+  try {
+    ModuleScanner scanner{false};
+    scanner.feed(code);
+    scanner.finish();
+    return scanner.memoryMaximum().value_or(maxWasmPages);
+  } catch (exception const&) {
+    return maxWasmPages;
+  }
+}
+
+evmc::bytes32 scanModule(bytes_view code)
+{
+  optional<evmc::bytes32> known = knownCodeHashOf(code);
+  ModuleScanner scanner{!known};
+  scanner.feed(code);
+  evmc::bytes32 hash = scanner.finish();
+  return known ? *known : hash;
+}
+
+}
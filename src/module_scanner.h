@@ -0,0 +1,107 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+#include "keccak.h"
+
+namespace hera {
+
+/// Checks the structure of a contract module in a single pass over its bytes, while
+/// they are fed, and hashes them on the way.
+///
+/// Only what ewasm requires on top of WebAssembly is checked: that the sections are in
+/// order, all imports are EEI functions of the "ethereum" namespace with the right type,
+/// the only exports are "main" (a function without parameters and results) and "memory",
+/// there is one memory and no start function. The code and data sections are not
+/// buffered, but skipped while they are fed, so junk is rejected long before any engine
+/// decodes the module. Throws ContractValidationFailure as soon as the bytes seen so far
+/// are invalid.
+class ModuleScanner {
+public:
+  explicit ModuleScanner(bool hashing = true) noexcept: m_hashing(hashing) {}
+
+  /// Scans the next @chunk of the module.
+  void feed(bytes_view chunk);
+
+  /// Ends the module. Returns the Keccak-256 hash of all bytes fed, or zero if not hashing.
+  evmc::bytes32 finish();
+
+  /// The maximum pages of the memory, if it declares one.
+  std::optional<uint32_t> memoryMaximum() const noexcept { return m_memoryMaximum; }
+
+private:
+  enum class State : uint8_t {
+    preamble,
+    sectionId,
+    sectionSize,
+    sectionBody,
+    skip,
+  };
+
+  struct FunctionType {
+    std::vector<uint8_t> params;
+    std::vector<uint8_t> results;
+  };
+
+  // Returns the next @length bytes into @unit once all of them are fed. The bytes are
+  // only copied if they are split over chunks.
+  bool take(bytes_view& chunk, size_t length, bytes_view& unit);
+
+  void scanSection(uint8_t id, bytes_view body);
+  void scanTypes(bytes_view body);
+  void scanImports(bytes_view body);
+  void scanFunctions(bytes_view body);
+  void scanMemories(bytes_view body);
+  void scanExports(bytes_view body);
+
+  bool const m_hashing;
+  Keccak256 m_hash;
+  bytes m_pending;
+  State m_state = State::preamble;
+  uint8_t m_sectionId = 0;
+  uint8_t m_lastSectionId = 0;
+  uint32_t m_sectionSize = 0;
+  unsigned m_sectionSizeShift = 0;
+  uint32_t m_skipped = 0;
+
+  // What the sections scanned so far declare.
+  std::vector<FunctionType> m_types;
+  uint32_t m_importedFunctions = 0;
+  std::vector<uint32_t> m_functionTypes;
+  uint32_t m_memories = 0;
+  std::optional<uint32_t> m_memoryMaximum;
+  bool m_mainExported = false;
+  bool m_memoryExported = false;
+};
+
+/// Returns the maximum pages the memory of @code declares, or maxWasmPages if it declares
+/// none or the module is invalid.
+uint64_t declaredMemoryMaximum(bytes_view code) noexcept;
+
+/// Scans the whole @code (see ModuleScanner) and returns its Keccak-256 hash,
+/// which is only computed if it is not known already (see KnownCodeHash).
+evmc::bytes32 scanModule(bytes_view code);
+
+}
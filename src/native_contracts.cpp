@@ -0,0 +1,55 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "keccak.h"
+#include "native_contracts.h"
+#include "sha256.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// Priced like the EVM counterparts: a base cost and a cost per 32 byte word of input.
+template <int64_t Base, int64_t PerWord>
+int64_t wordGas(bytes_view input) noexcept
+{
+  return Base + PerWord * static_cast<int64_t>((input.size() + 31) / 32);
+}
+
+bytes hashOutput(evmc::bytes32 const& hash)
+{
+  return bytes(hash.bytes, sizeof(hash.bytes));
+}
+
+constexpr NativeContract nativeContracts[] = {
+  { "keccak256", wordGas<30, 6>, [](bytes_view input) { return hashOutput(keccak256(input)); } },
+  { "sha256", wordGas<60, 12>, [](bytes_view input) { return hashOutput(sha256(input)); } },
+  { "identity", wordGas<15, 3>, [](bytes_view input) { return bytes(input); } },
+};
+
+}
+
+NativeContract const* findNativeContract(string_view name) noexcept
+{
+  for (NativeContract const& contract: nativeContracts)
+    if (name == contract.name)
+      return &contract;
+  return nullptr;
+}
+
+}
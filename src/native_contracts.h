@@ -0,0 +1,39 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "helpers.h"
+
+namespace hera {
+
+/// A contract implemented in C++, which hera_execute runs instead of the code at the
+/// address it is bound to (see the "sys:" option), without instantiating an engine.
+struct NativeContract {
+  char const* name;
+  /// The gas charged for @input, the execution fails if it exceeds the gas available.
+  int64_t (*gas)(bytes_view input) noexcept;
+  /// Returns the output for @input.
+  bytes (*execute)(bytes_view input);
+};
+
+/// Returns the native contract called @name or nullptr.
+NativeContract const* findNativeContract(std::string_view name) noexcept;
+
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nested_call.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+struct NestedCall {
+  int32_t depth;
+  evmc::address destination;
+  evmc::bytes32 codeHash;
+};
+
+thread_local bool recordingEnabled = false;
+thread_local optional<NestedCall> recordedCall;
+
+}
+
+NestedCallRecording::NestedCallRecording(bool enabled) noexcept: m_previous(recordingEnabled)
+{
+  recordingEnabled = enabled;
+}
+
+NestedCallRecording::~NestedCallRecording() noexcept
+{
+  recordingEnabled = m_previous;
+}
+
+bool nestedCallRecordingEnabled() noexcept
+{
+  return recordingEnabled;
+}
+
+void recordNestedCall(evmc_message const& message, evmc::bytes32 const& codeHash) noexcept
+{
+  // The code of the destination is only run by plain calls, other kinds may run other code.
+  if (!recordingEnabled || message.kind != EVMC_CALL || evmc::is_zero(codeHash)) {
+    recordedCall.reset();
+    return;
+  }
+
+  recordedCall = NestedCall{message.depth, message.destination, codeHash};
+}
+
+void clearNestedCall() noexcept
+{
+  recordedCall.reset();
+}
+
+optional<evmc::bytes32> takeNestedCall(evmc_message const& message) noexcept
+{
+  optional<NestedCall> call;
+  call.swap(recordedCall);
+  if (!call || message.kind != EVMC_CALL || call->depth != message.depth || call->destination != message.destination)
+    return nullopt;
+  return call->codeHash;
+}
+
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <optional>
+
+#include <evmc/evmc.hpp>
+
+namespace hera {
+
+// With the nested call fast path, an EthereumInterface handing a call to the host records
+// which code the callee runs, so that the nested execution (which the host usually gives
+// back to Hera on the same thread) can skip hashing and preparing that code again.
+
+/// Enables recording calls on this thread while in scope.
+class NestedCallRecording {
+public:
+  explicit NestedCallRecording(bool enabled) noexcept;
+  ~NestedCallRecording() noexcept;
+
+  NestedCallRecording(NestedCallRecording const&) = delete;
+  NestedCallRecording& operator=(NestedCallRecording const&) = delete;
+
+private:
+  bool const m_previous;
+};
+
+/// Whether calls are to be recorded on this thread, see NestedCallRecording.
+bool nestedCallRecordingEnabled() noexcept;
+
+/// Records that the host is about to be asked to run @message, which executes the code
+/// of its destination, hashed as @codeHash by the host. That hash is not verified, so it is
+/// only a hint for lookups. Only plain calls are recorded.
+void recordNestedCall(evmc_message const& message, evmc::bytes32 const& codeHash) noexcept;
+
+/// Forgets the recorded call, e.g. when the host returned without executing it in Hera.
+void clearNestedCall() noexcept;
+
+/// Returns the hash of the code recorded for @message, if it is the recorded call, and forgets it.
+std::optional<evmc::bytes32> takeNestedCall(evmc_message const& message) noexcept;
+
+}
@@ -21,8 +21,16 @@
 #ifndef wasm_shell_interface_h
 #define wasm_shell_interface_h
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <vector>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <wasm.h>
 #include <wasm-interpreter.h>
 
@@ -32,62 +40,88 @@ struct ExitException {};
 struct TrapException {};
 
 struct ShellExternalInterface : ModuleInstance::ExternalInterface {
-  // The underlying memory can be accessed through unaligned pointers which
-  // isn't well-behaved in C++. WebAssembly nonetheless expects it to behave
-  // properly. Avoid emitting unaligned load/store by checking for alignment
-  // explicitly, and performing memcpy if unaligned.
+  // The linear memory is a single anonymous mapping reserving the most the
+  // memory can grow to plus a guard region. Only the first size() bytes are
+  // accessible. Growing makes more of the reservation accessible in place, so
+  // the memory never moves or gets copied, and the fresh pages come zeroed
+  // from the kernel. Anything beyond is PROT_NONE and faults instead of
+  // touching unrelated memory. The interpreter checks every access against
+  // size(), so the guard only has to cover the width of a single access.
   //
-  // The allocated memory tries to have the same alignment as the memory being
-  // simulated.
+  // The mapping is page-aligned, so the alignment of a host address matches
+  // that of the simulated one. Accesses go through memcpy, which compiles to a
+  // single load or store and is well-defined for unaligned addresses too.
   class Memory {
+    static constexpr size_t maxSize = size_t{1} << 32;
+    static constexpr size_t guardSize = size_t{1} << 16;
+
     // Use char because it doesn't run afoul of aliasing rules.
-    std::vector<char> memory;
-    template <typename T>
-    static bool aligned(const char* address) {
-      static_assert(!(sizeof(T) & (sizeof(T) - 1)), "must be a power of 2");
-      return 0 == (reinterpret_cast<uintptr_t>(address) & (sizeof(T) - 1));
+    char* memory = nullptr;
+    size_t memorySize = 0;
+    // The most the memory can grow to, and the size of the mapping.
+    size_t maximumSize = 0;
+    size_t reservedSize = 0;
+    // The accessible prefix of the mapping, a multiple of the system page size.
+    size_t committed = 0;
+
+    static size_t pageSize() {
+      static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+      return size;
+    }
+    static size_t roundUp(size_t size) {
+      return (size + pageSize() - 1) & ~(pageSize() - 1);
     }
     Memory(Memory&) = delete;
     Memory& operator=(const Memory&) = delete;
 
    public:
-    Memory() {}
+    Memory() = default;
+    ~Memory() {
+      if (memory) ::munmap(memory, reservedSize);
+    }
+    // Maps the memory, which can grow up to @maximum bytes. Called once, before resizing.
+    void reserve(size_t maximum) {
+      static_assert(sizeof(size_t) >= 8, "the reservation needs a 64-bit address space");
+      assert(!memory);
+      maximumSize = std::min(maximum, maxSize);
+      reservedSize = roundUp(maximumSize) + guardSize;
+      void* mapping = ::mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (mapping == MAP_FAILED) throw std::bad_alloc();
+      memory = static_cast<char*>(mapping);
+    }
     // Gives no guarantee about the length of the memory. Caller needs to ensure that.
     char* rawpointer(size_t offset) {
-      return &memory[offset];
+      return memory + offset;
     }
-    size_t size() const { return memory.size(); }
+    size_t size() const { return memorySize; }
     void resize(size_t newSize) {
-      // Ensure the smallest allocation is large enough that most allocators
-      // will provide page-aligned storage. This hopefully allows the
-      // interpreter's memory to be as aligned as the memory being simulated,
-      // ensuring that the performance doesn't needlessly degrade.
-      //
-      // The code is optimistic this will work until WG21's p0035r0 happens.
-      const size_t minSize = 1 << 12;
-      size_t oldSize = memory.size();
-      memory.resize(std::max(minSize, newSize));
-      if (newSize < oldSize && newSize < minSize) {
-        std::memset(&memory[newSize], 0, minSize - newSize);
+      // The interpreter does not grow beyond the declared maximum.
+      if (newSize > maximumSize) throw std::bad_alloc();
+      size_t newCommitted = roundUp(newSize);
+      if (newCommitted > committed) {
+        if (::mprotect(memory + committed, newCommitted - committed, PROT_READ | PROT_WRITE) != 0)
+          throw std::bad_alloc();
+      } else if (newCommitted < committed) {
+        // Give the pages back, they read as zero should they be committed again.
+        ::madvise(memory + newCommitted, committed - newCommitted, MADV_DONTNEED);
+        ::mprotect(memory + newCommitted, committed - newCommitted, PROT_NONE);
       }
+      // What remains of a page which was partially released must read as zero as well.
+      if (newSize < memorySize) {
+        std::memset(memory + newSize, 0, std::min(memorySize, newCommitted) - newSize);
+      }
+      committed = newCommitted;
+      memorySize = newSize;
     }
     template <typename T>
     void set(size_t address, T value) {
-      if (aligned<T>(&memory[address])) {
-        *reinterpret_cast<T*>(&memory[address]) = value;
-      } else {
-        std::memcpy(&memory[address], &value, sizeof(T));
-      }
+      std::memcpy(memory + address, &value, sizeof(T));
     }
     template <typename T>
     T get(size_t address) {
-      if (aligned<T>(&memory[address])) {
-        return *reinterpret_cast<T*>(&memory[address]);
-      } else {
-        T loaded;
-        std::memcpy(&loaded, &memory[address], sizeof(T));
-        return loaded;
-      }
+      T loaded;
+      std::memcpy(&loaded, memory + address, sizeof(T));
+      return loaded;
     }
   } memory;
 
@@ -95,7 +129,13 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
 
   ShellExternalInterface() : memory() {}
 
+  // Lowers the pages reserved for the memory below its declared maximum, for
+  // memories which are kept from growing beyond @pages otherwise.
+  void limitMemory(size_t pages) { memoryLimit = pages; }
+
   void init(Module& wasm, ModuleInstance& instance) override {
+    size_t maximumPages = std::max<size_t>(wasm.memory.initial, std::min<size_t>(wasm.memory.max, memoryLimit));
+    memory.reserve(maximumPages * wasm::Memory::kPageSize);
     memory.resize(wasm.memory.initial * wasm::Memory::kPageSize);
     // apply memory segments
     for (auto& segment : wasm.memory.segments) {
@@ -167,6 +207,9 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
     std::cerr << "[trap " << why << "]\n";
     throw TrapException();
   }
+
+ private:
+  size_t memoryLimit = SIZE_MAX;
 };
 
 }
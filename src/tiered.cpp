@@ -0,0 +1,224 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "debugging.h"
+#include "keccak.h"
+#include "tiered.h"
+#if HERA_BINARYEN
+#include "binaryen.h"
+#endif
+#if HERA_WABT
+#include "wabt.h"
+#endif
+#if HERA_WAVM
+#include "wavm.h"
+#endif
+#if HERA_WASMER
+#include "wasmer.h"
+#endif
+
+using namespace std;
+
+namespace hera {
+
+/// Compiles code with the optimizing tier on a thread of its own, started on first use.
+/// Jobs wait in a bounded queue, and are dropped when stopping.
+class BackgroundCompiler {
+public:
+  explicit BackgroundCompiler(WasmEngine& engine) noexcept: m_engine(engine) {}
+
+  ~BackgroundCompiler() noexcept
+  {
+    {
+      lock_guard<mutex> lock{m_mutex};
+      m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  /// Returns false if the job was not queued.
+  bool schedule(bytes code, shared_ptr<TieredEngine::TierState> state) noexcept
+  {
+    try {
+      lock_guard<mutex> lock{m_mutex};
+      if (m_stop || m_jobs.size() >= maxJobs)
+        return false;
+      if (!m_thread.joinable())
+        m_thread = thread([this] { run(); });
+      m_jobs.push_back(Job{move(code), move(state)});
+    } catch (...) {
+      return false;
+    }
+    m_wakeUp.notify_one();
+    return true;
+  }
+
+private:
+  static constexpr size_t maxJobs = 64;
+
+  struct Job {
+    bytes code;
+    shared_ptr<TieredEngine::TierState> state;
+  };
+
+  void run()
+  {
+    unique_lock<mutex> lock{m_mutex};
+    while (true) {
+      m_wakeUp.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_stop)
+        return;
+      Job job = move(m_jobs.front());
+      m_jobs.pop_front();
+      lock.unlock();
+
+      bool kept = false;
+      try {
+        kept = m_engine.precompile(job.code);
+      } catch (exception const& e) {
+        HERA_DEBUG << "Background compilation failed: " << e.what() << "\n";
+      }
+      // Release, so executions seeing the optimized tier also see the cached module.
+      job.state->tier.store(kept ? TieredEngine::Tier::optimized : TieredEngine::Tier::baselineOnly, memory_order_release);
+
+      lock.lock();
+    }
+  }
+
+  WasmEngine& m_engine;
+  mutex m_mutex;
+  condition_variable m_wakeUp;
+  deque<Job> m_jobs;
+  bool m_stop = false;
+  thread m_thread;
+};
+
+TieredEngine::TieredEngine(unique_ptr<WasmEngine> baseline, unique_ptr<WasmEngine> optimizing):
+  m_baseline(move(baseline)),
+  m_optimizing(move(optimizing)),
+  m_compiler(make_unique<BackgroundCompiler>(*m_optimizing))
+{}
+
+TieredEngine::~TieredEngine() noexcept = default;
+
+unique_ptr<WasmEngine> TieredEngine::create()
+{
+  return make_unique<TieredEngine>(
+#if HERA_WABT
+    WabtEngine::create(),
+#else
+    BinaryenEngine::create(),
+#endif
+#if HERA_WAVM
+    WavmEngine::create()
+#else
+    WasmerEngine::create()
+#endif
+  );
+}
+
+ExecutionResult TieredEngine::execute(
+  evmc::HostContext& context,
+  bytes_view code,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  // Without a cache to count executions in, everything stays in the baseline tier.
+  if (m_tiers.capacity() == 0)
+    return m_baseline->execute(context, code, state_code, msg, meterInterfaceGas);
+
+  CodeHash codeHash = codeHashOf(code);
+  shared_ptr<TierState> state = m_tiers.find(codeHash);
+  if (!state) {
+    state = make_shared<TierState>();
+    m_tiers.insert(codeHash, state);
+  }
+
+  if (state->tier.load(memory_order_acquire) == Tier::optimized) {
+    if (m_optimizing->isCompiled(code))
+      return m_optimizing->execute(context, code, state_code, msg, meterInterfaceGas);
+    // The optimizing tier evicted the module. Rather than compiling it here, count the
+    // executions again and have it compiled in the background once it is hot.
+    Tier expected = Tier::optimized;
+    if (state->tier.compare_exchange_strong(expected, Tier::baseline, memory_order_relaxed))
+      state->executions.store(0, memory_order_relaxed);
+  }
+
+  // Only the execution crossing the threshold schedules the compilation.
+  if (state->executions.fetch_add(1, memory_order_relaxed) + 1 == m_threshold.load(memory_order_relaxed)) {
+    Tier expected = Tier::baseline;
+    if (state->tier.compare_exchange_strong(expected, Tier::compiling, memory_order_relaxed)) {
+      HERA_DEBUG << "Compiling hot code in the background.\n";
+      if (!m_compiler->schedule(bytes{code}, state)) {
+        // Try again after as many executions.
+        state->executions.store(0, memory_order_relaxed);
+        state->tier.store(Tier::baseline, memory_order_relaxed);
+      }
+    }
+  }
+
+  return m_baseline->execute(context, code, state_code, msg, meterInterfaceGas);
+}
+
+void TieredEngine::setModuleCacheSize(size_t size)
+{
+  m_baseline->setModuleCacheSize(size);
+  m_optimizing->setModuleCacheSize(size);
+  m_tiers.setCapacity(size);
+}
+
+void TieredEngine::setInstancePoolSize(size_t size)
+{
+  m_baseline->setInstancePoolSize(size);
+  m_optimizing->setInstancePoolSize(size);
+}
+
+void TieredEngine::setArtifactDirectory(string const& directory)
+{
+  m_baseline->setArtifactDirectory(directory);
+  m_optimizing->setArtifactDirectory(directory);
+}
+
+void TieredEngine::enableBenchmarking() noexcept
+{
+  WasmEngine::enableBenchmarking();
+  m_baseline->enableBenchmarking();
+  m_optimizing->enableBenchmarking();
+}
+
+void TieredEngine::enableStorageCache() noexcept
+{
+  WasmEngine::enableStorageCache();
+  m_baseline->enableStorageCache();
+  m_optimizing->enableStorageCache();
+}
+
+void TieredEngine::setMemoryBudget(MemoryBudget* budget) noexcept
+{
+  WasmEngine::setMemoryBudget(budget);
+  m_baseline->setMemoryBudget(budget);
+  m_optimizing->setMemoryBudget(budget);
+}
+
+}
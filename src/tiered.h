@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "cache.h"
+#include "eei.h"
+
+namespace hera {
+
+class BackgroundCompiler;
+
+/// Runs code in an interpreter (the baseline tier) until it was executed a number of
+/// times, then has it compiled by a compiling engine (the optimizing tier) on a background
+/// thread. Executions switch to the optimizing tier while the module is in its cache.
+class TieredEngine : public WasmEngine {
+public:
+  TieredEngine(std::unique_ptr<WasmEngine> baseline, std::unique_ptr<WasmEngine> optimizing);
+  ~TieredEngine() noexcept override;
+
+  /// Factory method to create the tiered engine from the interpreter and the compiler preferred.
+  static std::unique_ptr<WasmEngine> create();
+
+  ExecutionResult execute(
+    evmc::HostContext& context,
+    bytes_view code,
+    bytes_view state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas
+  ) override;
+
+  void verifyContract(bytes_view code) override { m_baseline->verifyContract(code); }
+
+  bool precompile(bytes_view code) override { return m_optimizing->precompile(code); }
+
+  void setModuleCacheSize(size_t size) override;
+  void setInstancePoolSize(size_t size) override;
+  void setArtifactDirectory(std::string const& directory) override;
+  void setTierUpThreshold(uint64_t threshold) override { m_threshold = threshold; }
+  void enableBenchmarking() noexcept override;
+  void enableStorageCache() noexcept override;
+  void setMemoryBudget(MemoryBudget* budget) noexcept override;
+
+  enum class Tier : uint8_t {
+    baseline,
+    compiling,
+    optimized,
+    // The optimizing tier rejected the code or does not keep it.
+    baselineOnly,
+  };
+
+  struct TierState {
+    std::atomic<uint64_t> executions{0};
+    std::atomic<Tier> tier{Tier::baseline};
+  };
+
+private:
+  std::unique_ptr<WasmEngine> m_baseline;
+  std::unique_ptr<WasmEngine> m_optimizing;
+  std::atomic<uint64_t> m_threshold{16};
+  ShardedLruCache<CodeHash, TierState, CodeHashHasher> m_tiers;
+  // Declared last, so it is stopped before the engines it compiles with are destroyed.
+  std::unique_ptr<BackgroundCompiler> m_compiler;
+};
+
+}
@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "src/interp/binary-reader-interp.h"
 #include "src/binary-reader.h"
@@ -32,7 +35,10 @@
 #include "wabt.h"
 #include "debugging.h"
 #include "eei.h"
+#include "eei_table.h"
 #include "exceptions.h"
+#include "keccak.h"
+#include "metrics.h"
 
 using namespace std;
 using namespace wabt;
@@ -46,9 +52,10 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _cacheStorage
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _cacheStorage)
   {}
 
   // TODO: improve this design...
@@ -69,1141 +76,267 @@ private:
   interp::Memory* m_wasmMemory;
 };
 
-unique_ptr<WasmEngine> WabtEngine::create()
-{
-  return unique_ptr<WasmEngine>{new WabtEngine};
-}
-
-ExecutionResult WabtEngine::execute(
-  evmc::HostContext& context,
-  bytes_view code,
-  bytes_view state_code,
-  evmc_message const& msg,
-  bool meterInterfaceGas
-) {
-  instantiationStarted();
-  HERA_DEBUG << "Executing with wabt...\n";
-
-  // Set up the wabt Environment, which includes the Wasm store
-  // and the list of modules used for importing/exporting between modules
-  interp::Environment env;
-
-  // Set up interface to eei host functions
-  ExecutionResult result;
-  WabtEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
-
-  // Create EEI host module
-  // The lifecycle of this pointer is handled by `env`.
-  interp::HostModule* hostModule = env.AppendHostModule("ethereum");
-  heraAssert(hostModule, "Failed to create host module.");
-
-  hostModule->AppendFuncExport(
-    "useGas",
-    {{Type::I64}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiUseGas(static_cast<int64_t>(args[0].value.i64));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getAddress",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetAddress(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getExternalBalance",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetExternalBalance(args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockHash",
-    {{Type::I64, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiGetBlockHash(args[0].value.i64, args[1].value.i32));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "call",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::Call,
-        static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
-        args[2].value.i32, args[3].value.i32, args[4].value.i32
-      ));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiCallDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCallDataSize",
-    {{}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiGetCallDataSize());
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callCode",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallCode,
-        static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
-        args[2].value.i32, args[3].value.i32, args[4].value.i32
-      ));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDelegate",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallDelegate,
-        static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
-        args[2].value.i32, args[3].value.i32
-      ));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callStatic",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallStatic,
-        static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
-        args[2].value.i32, args[3].value.i32
-      ));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageStore",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiStorageStore(args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageLoad",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiStorageLoad(args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCaller",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetCaller(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCallValue",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetCallValue(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "codeCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiCodeCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCodeSize",
-    {{}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiGetCodeSize());
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockCoinbase",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetBlockCoinbase(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "create",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiCreate(
-        args[0].value.i32, args[1].value.i32,
-        args[2].value.i32, args[3].value.i32
-      ));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockDifficulty",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetBlockDifficulty(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "externalCodeCopy",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiExternalCodeCopy(
-        args[0].value.i32, args[1].value.i32,
-        args[2].value.i32, args[3].value.i32
-      );
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getExternalCodeSize",
-    {{Type::I32}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiGetExternalCodeSize(args[0].value.i32));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getGasLeft",
-    {{}, {Type::I64}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetGasLeft()));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockGasLimit",
-    {{}, {Type::I64}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockGasLimit()));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getTxGasPrice",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetTxGasPrice(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "log",
-    {{Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiLog(
-        args[0].value.i32, args[1].value.i32, args[2].value.i32, args[3].value.i32,
-        args[4].value.i32, args[5].value.i32, args[6].value.i32
-      );
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockNumber",
-    {{}, {Type::I64}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockNumber()));
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getTxOrigin",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiGetTxOrigin(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "finish",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiFinish(args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "revert",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiRevert(args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getReturnDataSize",
-    {{}, {Type::I32}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i32(interface.eeiGetReturnDataSize());
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "returnDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiReturnDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "selfDestruct",
-    {{Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.eeiSelfDestruct(args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockTimestamp",
-    {{}, {Type::I64}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues& results
-    ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockTimestamp()));
-      return interp::Result::Ok;
-    }
-  );
-
-#if HERA_DEBUGGING
-  // Create debug host module
-  // The lifecycle of this pointer is handled by `env`.
-  hostModule = env.AppendHostModule("debug");
-  heraAssert(hostModule, "Failed to create host module.");
-
-  hostModule->AppendFuncExport(
-    "printMem",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.debugPrintMem(false, args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printMemHex",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.debugPrintMem(true, args[0].value.i32, args[1].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printStorage",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.debugPrintStorage(false, args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printStorageHex",
-    {{Type::I32, Type::I32}, {}},
-    [&interface](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues& args,
-      interp::TypedValues&
-    ) {
-      interface.debugPrintStorage(true, args[0].value.i32);
-      return interp::Result::Ok;
-    }
-  );
-#endif
-
-  // Parse module
-  ReadBinaryOptions options(
-    Features{},
-    nullptr, // debugging stream for loading
-    false, // ReadDebugNames
-    true, // StopOnFirstError
-    true // FailOnCustomSectionError
-  );
-
-  Errors errors;
-  interp::DefinedModule* module = nullptr;
-  Result loadResult = ReadBinaryInterp(
-    &env,
-    code.data(),
-    code.size(),
-    options,
-    &errors,
-    &module
-  );
-
-#if HERA_DEBUGGING
-  for (auto it = errors.begin(); it != errors.end(); ++it) {
-    HERA_DEBUG << "wabt (execute): " << it->message << "\n";
-  }
-#endif
-
-  ensureCondition(Succeeded(loadResult) && module, ContractValidationFailure, "Module failed to load.");
-  ensureCondition(env.GetMemoryCount() == 1, ContractValidationFailure, "Multiple memory sections exported.");
-  ensureCondition(module->GetExport("memory"), ContractValidationFailure, "\"memory\" not found");
-  ensureCondition(module->start_func_index == kInvalidIndex, ContractValidationFailure, "Contract contains start function.");
-
-  // Prepare to execute
-  interp::Export* mainFunction = module->GetExport("main");
-  ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
-  ensureCondition(mainFunction->kind == ExternalKind::Func, ContractValidationFailure,  "\"main\" is not a function");
-  interp::Executor executor(
-    &env,
-    nullptr, // null for no tracing
-    interp::Thread::Options{} // empty for no threads
-  );
-
-  // FIXME: really bad design
-  interface.setWasmMemory(env.GetMemory(0));
-
-  executionStarted();
+namespace {
 
-  // Execute main
-  try {
-    interp::ExecResult wabtResult = executor.RunExport(mainFunction, interp::TypedValues{}); // second arg is empty since no args
-    // Wrap any non-EEI exception under VMTrap.
-    ensureCondition(wabtResult.result == interp::Result::Ok, VMTrap, "The VM invocation had a trap.");
-  } catch (EndExecution const&) {
-    // This exception is ignored here because we consider it to be a success.
-    // It is only a clutch for POSIX style exit()
-  }
+// Host functions are registered once per environment and reach the
+// interface of the currently running execution through this slot.
+struct WabtInterfaceSlot {
+  WabtEthereumInterface* interface = nullptr;
+};
 
-  executionFinished();
-  return result;
+Type toWabtType(EEIValueType type)
+{
+  heraAssert(type != EEIValueType::none, "EEI parameters and results have a type.");
+  return (type == EEIValueType::i64) ? Type::I64 : Type::I32;
 }
 
-void WabtEngine::verifyContract(bytes_view code) {
-  // Set up the wabt Environment, which includes the Wasm store
-  // and the list of modules used for importing/exporting between modules
-  interp::Environment env;
-
-  // Create EEI host module
-  // The lifecycle of this pointer is handled by `env`.
-  interp::HostModule* hostModule = env.AppendHostModule("ethereum");
-  heraAssert(hostModule, "Failed to create host module.");
-
-  hostModule->AppendFuncExport(
-    "useGas",
-    {{Type::I64}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getAddress",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getExternalBalance",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockHash",
-    {{Type::I64, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "call",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCallDataSize",
-    {{}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callCode",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDelegate",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callStatic",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageStore",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageLoad",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCaller",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+void appendHostModules(interp::Environment& env, WabtInterfaceSlot& slot)
+{
+  // Create EEI host module
+  // The lifecycle of this pointer is handled by `env`.
+  interp::HostModule* hostModule = env.AppendHostModule("ethereum");
+  heraAssert(hostModule, "Failed to create host module.");
 
-  hostModule->AppendFuncExport(
-    "getCallValue",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  for (EEIFunction const& function: eeiFunctions) {
+    interp::FuncSignature signature;
+    for (size_t i = 0; i < function.paramCount; ++i)
+      signature.param_types.push_back(toWabtType(function.params[i]));
+    if (function.result != EEIValueType::none)
+      signature.result_types.push_back(toWabtType(function.result));
+
+    hostModule->AppendFuncExport(
+      function.name,
+      signature,
+      [&slot, &function](
+        const interp::HostFunc*,
+        const interp::FuncSignature*,
+        const interp::TypedValues& args,
+        interp::TypedValues& results
+      ) {
+        uint64_t values[maxEEIParams];
+        for (size_t i = 0; i < function.paramCount; ++i)
+          values[i] = (function.params[i] == EEIValueType::i64) ? args[i].value.i64 : args[i].value.i32;
+        uint64_t ret = function.call(*slot.interface, values);
+        if (function.result == EEIValueType::i32)
+          results[0].set_i32(static_cast<uint32_t>(ret));
+        else if (function.result == EEIValueType::i64)
+          results[0].set_i64(ret);
+        return interp::Result::Ok;
+      }
+    );
+  }
 
-  hostModule->AppendFuncExport(
-    "codeCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+#if HERA_DEBUGGING
+  // Create debug host module
+  // The lifecycle of this pointer is handled by `env`.
+  hostModule = env.AppendHostModule("debug");
+  heraAssert(hostModule, "Failed to create host module.");
 
   hostModule->AppendFuncExport(
-    "getCodeSize",
-    {{}, {Type::I32}},
-    [](
+    "printMem",
+    {{Type::I32, Type::I32}, {}},
+    [&slot](
       const interp::HostFunc*,
       const interp::FuncSignature*,
-      const interp::TypedValues&,
+      const interp::TypedValues& args,
       interp::TypedValues&
     ) {
+      slot.interface->debugPrintMem(false, args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
 
   hostModule->AppendFuncExport(
-    "getBlockCoinbase",
-    {{Type::I32}, {}},
-    [](
+    "printMemHex",
+    {{Type::I32, Type::I32}, {}},
+    [&slot](
       const interp::HostFunc*,
       const interp::FuncSignature*,
-      const interp::TypedValues&,
+      const interp::TypedValues& args,
       interp::TypedValues&
     ) {
+      slot.interface->debugPrintMem(true, args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
 
   hostModule->AppendFuncExport(
-    "create",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
+    "printStorage",
+    {{Type::I32, Type::I32}, {}},
+    [&slot](
       const interp::HostFunc*,
       const interp::FuncSignature*,
-      const interp::TypedValues&,
+      const interp::TypedValues& args,
       interp::TypedValues&
     ) {
+      slot.interface->debugPrintStorage(false, args[0].value.i32);
       return interp::Result::Ok;
     }
   );
 
   hostModule->AppendFuncExport(
-    "getBlockDifficulty",
-    {{Type::I32}, {}},
-    [](
+    "printStorageHex",
+    {{Type::I32, Type::I32}, {}},
+    [&slot](
       const interp::HostFunc*,
       const interp::FuncSignature*,
-      const interp::TypedValues&,
+      const interp::TypedValues& args,
       interp::TypedValues&
     ) {
+      slot.interface->debugPrintStorage(true, args[0].value.i32);
       return interp::Result::Ok;
     }
   );
+#endif
+}
 
-  hostModule->AppendFuncExport(
-    "externalCodeCopy",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+}
 
-  hostModule->AppendFuncExport(
-    "getExternalCodeSize",
-    {{Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+// The memory a pooled module may keep beyond its initial memory, as the memory it grew to
+// stays allocated while it is idle, outside of the "memory-budget".
+constexpr size_t maxPooledMemoryGrowth = 16 * 65536;
 
-  hostModule->AppendFuncExport(
-    "getGasLeft",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+// A decoded and validated contract in its own environment, ready to run.
+struct WabtModule {
+  interp::Environment env;
+  WabtInterfaceSlot slot;
+  interp::DefinedModule* module = nullptr;
+  interp::Export* mainFunction = nullptr;
+
+  // Memory and globals right after instantiation, restored before a cached module is reused.
+  Limits initialPageLimits;
+  vector<char> initialMemory;
+  vector<interp::TypedValue> initialGlobals;
+
+  void saveInitialState()
+  {
+    interp::Memory* memory = env.GetMemory(0);
+    initialPageLimits = memory->page_limits;
+    initialMemory = memory->data;
+    initialGlobals.clear();
+    for (Index i = 0; i < env.GetGlobalCount(); ++i)
+      initialGlobals.push_back(env.GetGlobal(i)->typed_value);
+  }
 
-  hostModule->AppendFuncExport(
-    "getBlockGasLimit",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  // Copies into the existing memory, which only ever grows, so nothing is allocated. Returns
+  // false if it has less capacity than the initial memory, or much more (see
+  // maxPooledMemoryGrowth), then the module must not be reused.
+  bool restoreInitialState() noexcept
+  {
+    interp::Memory* memory = env.GetMemory(0);
+    size_t capacity = memory->data.capacity();
+    if (capacity < initialMemory.size() || capacity - initialMemory.size() > maxPooledMemoryGrowth)
+      return false;
+    memory->page_limits = initialPageLimits;
+    memory->data.assign(initialMemory.begin(), initialMemory.end());
+    for (Index i = 0; i < initialGlobals.size(); ++i)
+      env.GetGlobal(i)->typed_value = initialGlobals[i];
+    return true;
+  }
+};
 
-  hostModule->AppendFuncExport(
-    "getTxGasPrice",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+namespace {
 
-  hostModule->AppendFuncExport(
-    "log",
-    {{Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+// Gives a pooled module back once the execution is finished, even if it failed.
+class WabtModuleLease {
+public:
+  WabtModuleLease(shared_ptr<WabtModule> module, shared_ptr<WabtModulePool> pool) noexcept:
+    m_module(move(module)), m_pool(move(pool))
+  {}
 
-  hostModule->AppendFuncExport(
-    "getBlockNumber",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  ~WabtModuleLease() noexcept
+  {
+    m_module->slot.interface = nullptr;
+    if (m_pool && m_module->restoreInitialState())
+      m_pool->release(move(m_module));
+  }
 
-  hostModule->AppendFuncExport(
-    "getTxOrigin",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  WabtModule& operator*() const noexcept { return *m_module; }
+  WabtModule* operator->() const noexcept { return m_module.get(); }
 
-  hostModule->AppendFuncExport(
-    "finish",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+private:
+  shared_ptr<WabtModule> m_module;
+  shared_ptr<WabtModulePool> m_pool;
+};
 
-  hostModule->AppendFuncExport(
-    "revert",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+}
 
-  hostModule->AppendFuncExport(
-    "getReturnDataSize",
-    {{}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+unique_ptr<WasmEngine> WabtEngine::create()
+{
+  return unique_ptr<WasmEngine>{new WabtEngine};
+}
 
-  hostModule->AppendFuncExport(
-    "returnDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+ExecutionResult WabtEngine::execute(
+  evmc::HostContext& context,
+  bytes_view code,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  BenchmarkTimer timer = instantiationStarted();
+  HERA_DEBUG << "Executing with wabt...\n";
+  PhaseTimer phases;
+  phases.start(Phase::parse);
+
+  // Reuse an idle instance of the module if there is one, otherwise decode a new one.
+  shared_ptr<WabtModulePool> pool = modulePool(code);
+  shared_ptr<WabtModule> module;
+  if (pool && (module = pool->acquire()))
+    HERA_DEBUG << "Using pooled module.\n";
+  if (!module)
+    module = loadModule(code);
+  WabtModuleLease lease{move(module), move(pool)};
 
-  hostModule->AppendFuncExport(
-    "selfDestruct",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  // Set up interface to eei host functions
+  phases.start(Phase::instantiate);
+  ExecutionResult result;
+  WabtEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas, storageCacheEnabled};
+  lease->slot.interface = &interface;
 
-  hostModule->AppendFuncExport(
-    "getBlockTimestamp",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
+  interp::Executor executor(
+    &lease->env,
+    nullptr, // null for no tracing
+    interp::Thread::Options{} // empty for no threads
   );
 
-#if HERA_DEBUGGING
-  // Create debug host module
-  // The lifecycle of this pointer is handled by `env`.
-  hostModule = env.AppendHostModule("debug");
-  heraAssert(hostModule, "Failed to create host module.");
+  // FIXME: really bad design
+  interp::Memory* memory = lease->env.GetMemory(0);
+  interface.setWasmMemory(memory);
+
+  uint64_t maximumPages = memory->page_limits.has_max ? memory->page_limits.max : maxWasmPages;
+  MemoryReservation reservation{memoryBudget, memory->page_limits.initial, maximumPages};
+  // memory.grow fails beyond the limit. Pooled modules get their limits back on release.
+  if (memoryBudget && memoryBudget->executionLimit()) {
+    memory->page_limits.max = max(memory->page_limits.initial, memoryBudget->limitMaximum(maximumPages));
+    memory->page_limits.has_max = true;
+  }
 
-  hostModule->AppendFuncExport(
-    "printMem",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  timer.executionStarted();
+  phases.start(Phase::execute);
 
-  hostModule->AppendFuncExport(
-    "printMemHex",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  // Execute main
+  try {
+    interp::ExecResult wabtResult = executor.RunExport(lease->mainFunction, interp::TypedValues{}); // second arg is empty since no args
+    // Wrap any non-EEI exception under VMTrap.
+    ensureCondition(wabtResult.result == interp::Result::Ok, VMTrap, "The VM invocation had a trap.");
+  } catch (EndExecution const&) {
+    // This exception is ignored here because we consider it to be a success.
+    // It is only a clutch for POSIX style exit()
+  }
 
-  hostModule->AppendFuncExport(
-    "printStorage",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
+  phases.stop();
+  timer.executionFinished(result);
+  return result;
+}
 
-  hostModule->AppendFuncExport(
-    "printStorageHex",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-#endif
+shared_ptr<WabtModule> WabtEngine::loadModule(bytes_view code)
+{
+  // Set up the wabt Environment, which includes the Wasm store
+  // and the list of modules used for importing/exporting between modules
+  auto ret = make_shared<WabtModule>();
+  interp::Environment& env = ret->env;
+
+  appendHostModules(env, ret->slot);
 
   // Parse module
   ReadBinaryOptions options(
@@ -1227,7 +360,7 @@ void WabtEngine::verifyContract(bytes_view code) {
 
 #if HERA_DEBUGGING
   for (auto it = errors.begin(); it != errors.end(); ++it) {
-    HERA_DEBUG << "wabt (verifyContract): " << it->message << "\n";
+    HERA_DEBUG << "wabt: " << it->message << "\n";
   }
 #endif
 
@@ -1239,6 +372,33 @@ void WabtEngine::verifyContract(bytes_view code) {
   interp::Export* mainFunction = module->GetExport("main");
   ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
   ensureCondition(mainFunction->kind == ExternalKind::Func, ContractValidationFailure,  "\"main\" is not a function");
-};
+
+  ret->module = module;
+  ret->mainFunction = mainFunction;
+  ret->saveInitialState();
+  return ret;
+}
+
+void WabtEngine::verifyContract(bytes_view code) {
+  shared_ptr<WabtModule> module = loadModule(code);
+
+  // Keep the decoded module, so the first execution of the contract skips decoding it.
+  if (shared_ptr<WabtModulePool> pool = modulePool(code))
+    pool->release(move(module));
+}
+
+shared_ptr<WabtModulePool> WabtEngine::modulePool(bytes_view code)
+{
+  if (m_moduleCache.capacity() == 0 || m_instancePoolSize == 0)
+    return {};
+
+  CodeHash codeHash = codeHashOf(code);
+  shared_ptr<WabtModulePool> pool = m_moduleCache.find(codeHash);
+  if (!pool) {
+    pool = make_shared<WabtModulePool>(m_instancePoolSize);
+    m_moduleCache.insert(codeHash, pool);
+  }
+  return pool;
+}
 
 }
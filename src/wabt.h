@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include "cache.h"
 #include "eei.h"
 
 namespace hera {
 
+struct WabtModule;
+using WabtModulePool = InstancePool<WabtModule>;
+
 class WabtEngine : public WasmEngine {
 public:
   /// Factory method to create the WABT Wasm Engine.
@@ -34,6 +38,20 @@ public:
   ) override;
 
   void verifyContract(bytes_view code) override;
+
+  void setModuleCacheSize(size_t size) override { m_moduleCache.setCapacity(size); }
+
+  void setInstancePoolSize(size_t size) override { m_instancePoolSize = size; }
+
+private:
+  /// Decodes and validates a module together with its environment and host modules.
+  std::shared_ptr<WabtModule> loadModule(bytes_view code);
+
+  /// Returns the pool of idle instances of @code, or nullptr if pooling is disabled.
+  std::shared_ptr<WabtModulePool> modulePool(bytes_view code);
+
+  ShardedLruCache<CodeHash, WabtModulePool, CodeHashHasher> m_moduleCache;
+  size_t m_instancePoolSize = 0;
 };
 
 }
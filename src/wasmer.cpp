@@ -17,9 +17,13 @@
 #include <vector>
 #include <memory>
 #include "debugging.h"
+#include "eei_table.h"
+#include "keccak.h"
+#include "metrics.h"
+#include "module_scanner.h"
+#include <cstring>
 #include <functional>
 #include <iostream>
-#include <set>
 
 using namespace std;
 
@@ -28,8 +32,8 @@ namespace hera
     class WasmerEthereumInterface : public EthereumInterface
     {
     public:
-        explicit WasmerEthereumInterface(evmc::HostContext &_context, bytes_view _code, evmc_message const &_msg, ExecutionResult &_result, bool _meterGas)
-            : EthereumInterface(_context, _code, _msg, _result, _meterGas)
+        explicit WasmerEthereumInterface(evmc::HostContext &_context, bytes_view _code, evmc_message const &_msg, ExecutionResult &_result, bool _meterGas, bool _cacheStorage)
+            : EthereumInterface(_context, _code, _msg, _result, _meterGas, _cacheStorage)
         {
         }
 
@@ -58,28 +62,38 @@ namespace hera
         const wasmer_memory_t *m_wasmMemory;
     };
 
-    unique_ptr<WasmEngine> WasmerEngine::create()
+    // Owns a compiled module, which any number of instances can be created from.
+    struct WasmerModule
     {
-        return unique_ptr<WasmEngine>{new WasmerEngine};
-    }
+        explicit WasmerModule(wasmer_module_t *_module) noexcept : module(_module) {}
+        ~WasmerModule() noexcept { wasmer_module_destroy(module); }
+
+        WasmerModule(WasmerModule const &) = delete;
+        WasmerModule &operator=(WasmerModule const &) = delete;
+
+        wasmer_module_t *const module;
+        // The declared maximum of the memory, which the C API does not expose.
+        uint64_t maximumPages = maxWasmPages;
+    };
+
     namespace
     {
+#if HERA_DEBUGGING
         wasmer_value_tag i32[] = {wasmer_value_tag::WASM_I32};
         wasmer_value_tag i64[] = {wasmer_value_tag::WASM_I64};
-        wasmer_value_tag i64_i32[] = {wasmer_value_tag::WASM_I64, wasmer_value_tag::WASM_I32};
         wasmer_value_tag i32_2[] = {wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32};
-        wasmer_value_tag i32_3[] = {wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32};
-        wasmer_value_tag i32_4[] = {wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32};
-        wasmer_value_tag i32_7[] = {wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32, wasmer_value_tag::WASM_I32};
+#endif
 
         // Function to print the most recent error string from Wasmer if we have them
         string getWasmerErrorString()
         {
             int error_len = wasmer_last_error_length();
-            char *error_str = new char[(uint64_t)error_len];
-            wasmer_last_error_message(error_str, error_len);
-            string error(error_str, (unsigned long)error_len);
-            delete[] error_str;
+            if (error_len <= 0)
+                return "unknown error";
+            string error((size_t)error_len, '\0');
+            wasmer_last_error_message(&error[0], error_len);
+            // The length includes the terminating null character.
+            error.resize(strlen(error.c_str()));
             return error;
         }
 
@@ -93,152 +107,34 @@ namespace hera
             return (WasmerEthereumInterface *)wasmer_instance_context_data_get(ctx);
         }
 
-        void eeiUseGas(wasmer_instance_context_t *ctx, int64_t gas)
+        wasmer_value_tag toWasmerType(EEIValueType type)
         {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiUseGas(gas);
-        }
-        int64_t eeiGetGasLeft(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetGasLeft();
-        }
-        void eeiGetAddress(wasmer_instance_context_t *ctx, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetAddress(resultOffset);
-        }
-        void eeiGetExternalBalance(wasmer_instance_context_t *ctx, uint32_t addressOffset, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetExternalBalance(addressOffset, resultOffset);
+            heraAssert(type != EEIValueType::none, "EEI parameters and results have a type.");
+            return (type == EEIValueType::i64) ? wasmer_value_tag::WASM_I64 : wasmer_value_tag::WASM_I32;
         }
 
-        uint32_t eeiGetBlockHash(wasmer_instance_context_t *ctx, uint64_t number, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetBlockHash(number, resultOffset);
-        }
-        uint32_t eeiGetCallDataSize(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetCallDataSize();
-        }
-        void eeiCallDataCopy(wasmer_instance_context_t *ctx, uint32_t resultOffset, uint32_t dataOffset, uint32_t length)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiCallDataCopy(resultOffset, dataOffset, length);
-        }
-        void eeiGetCaller(wasmer_instance_context_t *ctx, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetCaller(resultOffset);
-        }
-        void eeiGetCallValue(wasmer_instance_context_t *ctx, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetCallValue(resultOffset);
-        }
-        void eeiCodeCopy(wasmer_instance_context_t *ctx, uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiCodeCopy(resultOffset, codeOffset, length);
-        }
-        uint32_t eeiGetCodeSize(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetCodeSize();
-        }
-        void eeiExternalCodeCopy(wasmer_instance_context_t *ctx, uint32_t addressOffset, uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiExternalCodeCopy(addressOffset, resultOffset, codeOffset, length);
-        }
-        uint32_t eeiGetExternalCodeSize(wasmer_instance_context_t *ctx, uint32_t addressOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetExternalCodeSize(addressOffset);
-        }
-        void eeiGetBlockCoinbase(wasmer_instance_context_t *ctx, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetBlockCoinbase(resultOffset);
-        }
-        void eeiGetBlockDifficulty(wasmer_instance_context_t *ctx, uint32_t offset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetBlockDifficulty(offset);
-        }
-        int64_t eeiGetBlockGasLimit(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetBlockGasLimit();
-        }
-        void eeiGetTxGasPrice(wasmer_instance_context_t *ctx, uint32_t valueOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetTxGasPrice(valueOffset);
-        }
-        void eeiLog(wasmer_instance_context_t *ctx, uint32_t dataOffset, uint32_t length, uint32_t numberOfTopics, uint32_t topic1, uint32_t topic2, uint32_t topic3, uint32_t topic4)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiLog(dataOffset, length, numberOfTopics, topic1, topic2, topic3, topic4);
-        }
-        int64_t eeiGetBlockNumber(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetBlockNumber();
-        }
-        int64_t eeiGetBlockTimestamp(wasmer_instance_context_t *ctx)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetBlockTimestamp();
-        }
-        void eeiGetTxOrigin(wasmer_instance_context_t *ctx, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiGetTxOrigin(resultOffset);
-        }
-        void eeiStorageStore(wasmer_instance_context_t *ctx, uint32_t pathOffset, uint32_t valueOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiStorageStore(pathOffset, valueOffset);
-        }
-        void eeiStorageLoad(wasmer_instance_context_t *ctx, uint32_t pathOffset, uint32_t resultOffset)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiStorageLoad(pathOffset, resultOffset);
-        }
-        void eeiFinish(wasmer_instance_context_t *ctx, uint32_t offset, uint32_t size)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiFinish(offset, size);
-        }
-        void eeiRevert(wasmer_instance_context_t *ctx, uint32_t offset, uint32_t size)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiRevert(offset, size);
-        }
-        uint32_t eeiGetReturnDataSize(wasmer_instance_context_t *ctx)
+        // The native host function of an EEI method, see HERA_EEI_FUNCTIONS.
+        template <auto Function, typename Result, typename... Params>
+        Result hostFunction(wasmer_instance_context_t *ctx, Params... params)
         {
             auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiGetReturnDataSize();
+            return invoke(Function, static_cast<EthereumInterface &>(*interface), params...);
         }
-        void eeiReturnDataCopy(wasmer_instance_context_t *ctx, uint32_t dataOffset, uint32_t offset, uint32_t size)
-        {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiReturnDataCopy(dataOffset, offset, size);
-        }
-        uint32_t eeiCreate(wasmer_instance_context_t *ctx, uint32_t valueOffset, uint32_t dataOffset, uint32_t length, uint32_t resultOffset)
+
+        using HostFunctionPointer = void (*)(void *);
+
+        template <auto Function, typename Result, typename... Params>
+        HostFunctionPointer hostFunctionFor(Result (EthereumInterface::*)(Params...))
         {
-            auto interface = getInterfaceFromVontext(ctx);
-            return interface->eeiCreate(valueOffset, dataOffset, length, resultOffset);
+            return (HostFunctionPointer)&hostFunction<Function, Result, Params...>;
         }
-        void eeiSelfDestruct(wasmer_instance_context_t *ctx, uint32_t addressOffset)
+
+        template <auto Function, typename Result, typename... Params>
+        HostFunctionPointer hostFunctionFor(Result (*)(EthereumInterface &, Params...))
         {
-            auto interface = getInterfaceFromVontext(ctx);
-            interface->eeiSelfDestruct(addressOffset);
+            return (HostFunctionPointer)&hostFunction<Function, Result, Params...>;
         }
+
 #if HERA_DEBUGGING
         void print32(wasmer_instance_context_t *, uint32_t value)
         {
@@ -269,110 +165,116 @@ namespace hera
             interface->debugPrintStorage(true, offset);
         }
 #endif
-        shared_ptr<vector<wasmer_import_t>> initImportes()
+
+        // Destroys the instance when the execution ends, also if it failed.
+        struct InstanceGuard
         {
-            wasmer_byte_array ethModule = getNameArray("ethereum");
-            shared_ptr<vector<wasmer_import_t>> imports(
-                new vector<wasmer_import_t>{
-                    {ethModule, getNameArray("useGas"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiUseGas, i64, 1, NULL, 0)},
-                    {ethModule, getNameArray("getGasLeft"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetGasLeft, NULL, 0, i64, 1)},
-                    {ethModule, getNameArray("getAddress"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetAddress, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("getExternalBalance"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetExternalBalance, i32_2, 2, NULL, 0)},
-                    {ethModule, getNameArray("getBlockHash"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockHash, i64_i32, 2, i32, 1)},
-                    {ethModule, getNameArray("getCallDataSize"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetCallDataSize, NULL, 0, i32, 1)},
-                    {ethModule, getNameArray("callDataCopy"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiCallDataCopy, i32_3, 3, i32, 1)},
-                    {ethModule, getNameArray("getCaller"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetCaller, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("getCallValue"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetCallValue, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("codeCopy"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiCodeCopy, i32_3, 3, NULL, 0)},
-                    {ethModule, getNameArray("getCodeSize"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetCodeSize, NULL, 0, i32, 1)},
-                    {ethModule, getNameArray("externalCodeCopy"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiExternalCodeCopy, i32_4, 4, NULL, 0)},
-                    {ethModule, getNameArray("getExternalCodeSize"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetExternalCodeSize, i32, 1, i32, 1)},
-                    {ethModule, getNameArray("getBlockCoinbase"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockCoinbase, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("getBlockDifficulty"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockDifficulty, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("getBlockGasLimit"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockGasLimit, NULL, 0, i64, 1)},
-                    {ethModule, getNameArray("getTxGasPrice"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetTxGasPrice, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("log"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiLog, i32_7, 7, NULL, 0)},
-                    {ethModule, getNameArray("getBlockNumber"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockNumber, NULL, 0, i64, 1)},
-                    {ethModule, getNameArray("getBlockTimestamp"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetBlockTimestamp, NULL, 0, i64, 1)},
-                    {ethModule, getNameArray("getTxOrigin"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetTxOrigin, i32, 1, NULL, 0)},
-                    {ethModule, getNameArray("storageStore"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiStorageStore, i32_2, 2, NULL, 0)},
-                    {ethModule, getNameArray("storageLoad"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiStorageLoad, i32_2, 2, NULL, 0)},
-                    {ethModule, getNameArray("finish"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiFinish, i32_2, 2, NULL, 0)},
-                    {ethModule, getNameArray("revert"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiRevert, i32_2, 2, NULL, 0)},
-                    {ethModule, getNameArray("getReturnDataSize"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiGetReturnDataSize, NULL, 0, i32, 1)},
-                    {ethModule, getNameArray("returnDataCopy"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiReturnDataCopy, i32_3, 3, NULL, 0)},
-                    {ethModule, getNameArray("create"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiCreate, i32_4, 4, NULL, 0)},
-                    {ethModule, getNameArray("selfDestruct"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))eeiSelfDestruct, i32, 1, NULL, 0)},
-                },
-                [](auto p) {
-                    for (size_t i = 0; i < p->size(); ++i)
-                    {
-                        wasmer_import_func_destroy((wasmer_import_func_t *)p->at(i).value.func);
-                    }
-                    delete p;
-                });
+            wasmer_instance_t *instance = NULL;
+            ~InstanceGuard() noexcept
+            {
+                if (instance)
+                    wasmer_instance_destroy(instance);
+            }
+        };
+    } // namespace
+
+    // The import object of every instance. The host functions find the interface of the
+    // execution in the context data of the instance, so one set of them serves all instances.
+    class WasmerImports
+    {
+    public:
+        WasmerImports()
+        {
+            try
+            {
+#define HERA_WASMER_IMPORT(name, function) add(makeEEIFunction<function>(#name), hostFunctionFor<function>(function));
+                HERA_EEI_FUNCTIONS(HERA_WASMER_IMPORT)
+#undef HERA_WASMER_IMPORT
 #if HERA_DEBUGGING
-            wasmer_byte_array debugModule = getNameArray("debug");
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("print32"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))print32, i32, 1, NULL, 0)});
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("print64"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))print64, i64, 1, NULL, 0)});
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("printMem"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))printMem, i32_2, 2, NULL, 0)});
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("printMemHex"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))printMemHex, i32_2, 2, NULL, 0)});
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("printStorage"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))printStorage, i32, 1, NULL, 0)});
-            imports->push_back(wasmer_import_t{debugModule, getNameArray("printStorageHex"), wasmer_import_export_kind::WASM_FUNCTION,
-                     .value.func = wasmer_import_func_new((void (*)(void *))printStorageHex, i32, 1, NULL, 0)});
+                add("debug", "print32", (void (*)(void *))print32, i32, 1, NULL, 0);
+                add("debug", "print64", (void (*)(void *))print64, i64, 1, NULL, 0);
+                add("debug", "printMem", (void (*)(void *))printMem, i32_2, 2, NULL, 0);
+                add("debug", "printMemHex", (void (*)(void *))printMemHex, i32_2, 2, NULL, 0);
+                add("debug", "printStorage", (void (*)(void *))printStorage, i32, 1, NULL, 0);
+                add("debug", "printStorageHex", (void (*)(void *))printStorageHex, i32, 1, NULL, 0);
 #endif
-            return imports;
+            }
+            catch (...)
+            {
+                destroy();
+                throw;
+            }
         }
-    } // namespace
-    static const set<string> eeiFunctions{"useGas", "getGasLeft", "getAddress", "getExternalBalance", "getBlockHash", "getCallDataSize", "callDataCopy", "getCaller",
-                                          "getCallValue", "codeCopy", "getCodeSize", "externalCodeCopy", "getExternalCodeSize", "getBlockCoinbase",
-                                          "getBlockDifficulty", "getBlockGasLimit", "getTxGasPrice", "log", "getBlockNumber", "getBlockTimestamp", "getTxOrigin", "storageStore",
-                                          "storageLoad", "finish", "revert", "getReturnDataSize", "returnDataCopy", "call", "callCode", "callDelegate", "callStatic", "create", "selfDestruct"};
-    void WasmerEngine::verifyContract(bytes_view code)
+
+        ~WasmerImports() noexcept { destroy(); }
+
+        WasmerImports(WasmerImports const &) = delete;
+        WasmerImports &operator=(WasmerImports const &) = delete;
+
+        // Instantiating only reads the imports, so they can be used by concurrent executions.
+        wasmer_import_t *data() noexcept { return m_imports.data(); }
+        int32_t size() const noexcept { return (int32_t)m_imports.size(); }
+
+    private:
+        void add(EEIFunction const &function, HostFunctionPointer func)
+        {
+            wasmer_value_tag params[maxEEIParams];
+            for (size_t i = 0; i < function.paramCount; ++i)
+                params[i] = toWasmerType(function.params[i]);
+            wasmer_value_tag result[1];
+            unsigned int resultLength = 0;
+            if (function.result != EEIValueType::none)
+                result[resultLength++] = toWasmerType(function.result);
+            // The signature is copied, the arrays need not outlive the function.
+            add("ethereum", function.name, func, params, (unsigned int)function.paramCount, result, resultLength);
+        }
+
+        void add(char const *moduleName, char const *name, void (*func)(void *), wasmer_value_tag const *params, unsigned int paramsLength, wasmer_value_tag const *returns, unsigned int returnsLength)
+        {
+            wasmer_import_t import;
+            import.module_name = getNameArray(moduleName);
+            import.import_name = getNameArray(name);
+            import.tag = wasmer_import_export_kind::WASM_FUNCTION;
+            import.value.func = wasmer_import_func_new(func, params, paramsLength, returns, returnsLength);
+            heraAssert(import.value.func, string("Failed to create host function ") + name + ".");
+            try
+            {
+                m_imports.push_back(import);
+            }
+            catch (...)
+            {
+                wasmer_import_func_destroy(const_cast<wasmer_import_func_t *>(import.value.func));
+                throw;
+            }
+        }
+
+        void destroy() noexcept
+        {
+            for (auto const &import : m_imports)
+                wasmer_import_func_destroy(const_cast<wasmer_import_func_t *>(import.value.func));
+            m_imports.clear();
+        }
+
+        vector<wasmer_import_t> m_imports;
+    };
+
+    WasmerEngine::WasmerEngine() : m_imports(new WasmerImports), m_artifactStore("wasmer", HERA_WASMER_VERSION)
     {
-        auto codeData = new unsigned char[code.size()];
-        memcpy(codeData, code.data(), code.size());
-        wasmer_module_t *module;
-        auto compile_result = wasmer_compile(&module, codeData, (unsigned int)code.size());
+    }
+
+    WasmerEngine::~WasmerEngine() noexcept = default;
 
-        ensureCondition(
-            compile_result == wasmer_result_t::WASMER_OK, ContractValidationFailure, "Compile wasm failed.");
+    unique_ptr<WasmEngine> WasmerEngine::create()
+    {
+        return unique_ptr<WasmEngine>{new WasmerEngine};
+    }
+
+    void WasmerEngine::verifyContract(bytes_view code)
+    {
+        // Compiled through the module cache, so the first execution of the contract reuses it.
+        shared_ptr<WasmerModule> module = compileModule(code);
         wasmer_export_descriptors_t *exports;
-        wasmer_export_descriptors(module, &exports);
+        wasmer_export_descriptors(module->module, &exports);
         auto len = wasmer_export_descriptors_len(exports);
         for (int i = 0; i < len; ++i)
         {
@@ -394,7 +296,7 @@ namespace hera
         }
         wasmer_export_descriptors_destroy(exports);
         wasmer_import_descriptors_t *imports;
-        wasmer_import_descriptors(module, &imports);
+        wasmer_import_descriptors(module->module, &imports);
         auto importsLength = wasmer_import_descriptors_len(imports);
 
         for (unsigned int i = 0; i < importsLength; ++i)
@@ -409,52 +311,138 @@ namespace hera
             ensureCondition(moduleName == "ethereum", ContractValidationFailure, "Import from invalid namespace.");
             auto nameBytes = wasmer_import_descriptor_name(importObj);
             string objectName((char *)nameBytes.bytes, nameBytes.bytes_len);
-            ensureCondition(eeiFunctions.count(objectName), ContractValidationFailure, "Importing invalid EEI method.");
+            ensureCondition(findEEIFunction(objectName), ContractValidationFailure, "Importing invalid EEI method.");
             ensureCondition(wasmer_import_descriptor_kind(importObj) == wasmer_import_export_kind::WASM_FUNCTION, ContractValidationFailure, "Imported function type mismatch.");
         }
         wasmer_import_descriptors_destroy(imports);
-        wasmer_module_destroy(module);
+    }
+
+    bool WasmerEngine::precompile(bytes_view code)
+    {
+        if (m_moduleCache.capacity() == 0)
+            return false;
+
+        compileModule(code);
+        return true;
+    }
+
+    bool WasmerEngine::isCompiled(bytes_view code)
+    {
+        return m_moduleCache.capacity() > 0 && m_moduleCache.find(codeHashOf(code));
+    }
+
+    shared_ptr<WasmerModule> WasmerEngine::compileModule(bytes_view code)
+    {
+        bool const useCache = m_moduleCache.capacity() > 0;
+        CodeHash codeHash{};
+        if (useCache || m_artifactStore.enabled())
+        {
+            codeHash = codeHashOf(code);
+            if (auto cached = m_moduleCache.find(codeHash))
+            {
+                HERA_DEBUG << "Using cached module.\n";
+                return cached;
+            }
+        }
+
+        PhaseTimer phases;
+        phases.start(Phase::compile);
+        shared_ptr<WasmerModule> compiled;
+        if (auto artifact = m_artifactStore.load(codeHash))
+        {
+            bytes_view payload = artifact->payload();
+            wasmer_serialized_module_t *serialized = NULL;
+            if (wasmer_serialized_module_from_bytes(&serialized, payload.data(), (uint32_t)payload.size()) == wasmer_result_t::WASMER_OK)
+            {
+                wasmer_module_t *module = NULL;
+                wasmer_result_t deserialize_result = wasmer_module_deserialize(&module, serialized);
+                wasmer_serialized_module_destroy(serialized);
+                if (deserialize_result == wasmer_result_t::WASMER_OK)
+                {
+                    compiled = make_shared<WasmerModule>(module);
+                    HERA_DEBUG << "Loaded precompiled module.\n";
+                }
+            }
+        }
+
+        if (!compiled)
+        {
+            // wasmer_compile does not modify the code, it only lacks the const qualifier.
+            wasmer_module_t *module = NULL;
+            wasmer_result_t compile_result = wasmer_compile(&module, const_cast<uint8_t *>(code.data()), (uint32_t)code.size());
+            ensureCondition(compile_result == wasmer_result_t::WASMER_OK, ContractValidationFailure, string("Compile wasm failed, ") + getWasmerErrorString());
+            compiled = make_shared<WasmerModule>(module);
+
+            if (m_artifactStore.enabled())
+            {
+                wasmer_serialized_module_t *serialized = NULL;
+                if (wasmer_module_serialize(&serialized, compiled->module) == wasmer_result_t::WASMER_OK)
+                {
+                    wasmer_byte_array serializedBytes = wasmer_serialized_module_bytes(serialized);
+                    m_artifactStore.save(codeHash, bytes_view{serializedBytes.bytes, serializedBytes.bytes_len});
+                    wasmer_serialized_module_destroy(serialized);
+                }
+            }
+        }
+
+        compiled->maximumPages = declaredMemoryMaximum(code);
+
+        if (useCache)
+            m_moduleCache.insert(codeHash, compiled);
+        return compiled;
     }
 
     ExecutionResult WasmerEngine::execute(evmc::HostContext &context, bytes_view code, bytes_view state_code, evmc_message const &msg, bool meterInterfaceGas)
     {
-        instantiationStarted();
+        BenchmarkTimer timer = instantiationStarted();
         HERA_DEBUG << "Executing with wasmer...\n";
+        // Compile (or reuse the compiled) module and instantiate it with our imports
+        shared_ptr<WasmerModule> module = compileModule(code);
+        PhaseTimer phases;
+        phases.start(Phase::instantiate);
         // Set up interface to eei host functions
         ExecutionResult result;
-        WasmerEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
-        // Define an array containing our imports
-        auto imports = initImportes();
-        // Instantiate a WebAssembly Instance from Wasm bytes and imports
-        wasmer_instance_t *instance = NULL;
-        auto codeData = new unsigned char[code.size()];
-        memcpy(codeData, code.data(), code.size());
-        wasmer_result_t compile_result =
-            wasmer_instantiate(&instance,                                       // Our reference to our Wasm instance
-                               codeData,                                        // The bytes of the WebAssembly modules
-                               (uint32_t)code.size(),                           // The length of the bytes of the WebAssembly module
-                               static_cast<wasmer_import_t *>(imports->data()), // The Imports array the will be used as our importObject
-                               (int32_t)imports->size()                         // The number of imports in the imports array
+        WasmerEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas, storageCacheEnabled};
+        InstanceGuard guard;
+        wasmer_result_t instantiate_result =
+            wasmer_module_instantiate(module->module,     // The compiled WebAssembly module
+                                      &guard.instance,    // Our reference to our Wasm instance
+                                      m_imports->data(),  // The Imports array the will be used as our importObject
+                                      m_imports->size()   // The number of imports in the imports array
             );
-
-        ensureCondition(compile_result == wasmer_result_t::WASMER_OK, ContractValidationFailure, string("Compile wasm failed, ") + getWasmerErrorString());
+        ensureCondition(instantiate_result == wasmer_result_t::WASMER_OK, ContractValidationFailure, string("Instantiate wasm failed, ") + getWasmerErrorString());
 
         // Assert the Wasm instantion completed
-        wasmer_instance_context_data_set(instance, (void *)&interface);
-        auto ctx = wasmer_instance_context_get(instance);
-        interface.setWasmMemory(wasmer_instance_context_memory(ctx, 0));
+        wasmer_instance_context_data_set(guard.instance, (void *)&interface);
+        auto ctx = wasmer_instance_context_get(guard.instance);
+        const wasmer_memory_t *memory = wasmer_instance_context_memory(ctx, 0);
+        interface.setWasmMemory(memory);
+        // The maximum of a memory cannot be lowered through the C API, the memory limit is kept by
+        // the guards hera_execute adds to memory.grow.
+        MemoryReservation reservation{memoryBudget, wasmer_memory_length(memory), module->maximumPages};
         // Call the Wasm function
-        wasmer_result_t call_result = wasmer_instance_call(
-            instance, // Our Wasm Instance
-            "main",   // the name of the exported function we want to call on the guest Wasm module
-            NULL,     // Our array of parameters
-            0,        // The number of parameters
-            NULL,     // Our array of results
-            0         // The number of results
-        );
-        ensureCondition(call_result == wasmer_result_t::WASMER_OK, EndExecution, string("Call main failed, ") + getWasmerErrorString());
-
-        wasmer_instance_destroy(instance);
+        timer.executionStarted();
+        phases.start(Phase::execute);
+        try
+        {
+            wasmer_result_t call_result = wasmer_instance_call(
+                guard.instance, // Our Wasm Instance
+                "main",         // the name of the exported function we want to call on the guest Wasm module
+                NULL,           // Our array of parameters
+                0,              // The number of parameters
+                NULL,           // Our array of results
+                0               // The number of results
+            );
+            ensureCondition(call_result == wasmer_result_t::WASMER_OK, VMTrap, string("Call main failed, ") + getWasmerErrorString());
+        }
+        catch (EndExecution const &)
+        {
+            // This exception is ignored here because we consider it to be a success.
+            // It is only a clutch for POSIX style exit()
+        }
+
+        phases.stop();
+        timer.executionFinished(result);
         return result;
     };
 } // namespace hera
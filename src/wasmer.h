@@ -13,11 +13,20 @@
 
 #pragma once
 
+#include "artifact_store.h"
+#include "cache.h"
 #include "eei.h"
+
 namespace hera {
+struct WasmerModule;
+class WasmerImports;
+
 class WasmerEngine : public WasmEngine {
 public:
-  /// Factory method to create the WABT Wasm Engine.
+  WasmerEngine();
+  ~WasmerEngine() noexcept override;
+
+  /// Factory method to create the Wasmer Wasm Engine.
   static std::unique_ptr<WasmEngine> create();
 
   ExecutionResult execute(
@@ -29,6 +38,24 @@ public:
   ) override;
 
   void verifyContract(bytes_view code) override;
+
+  bool precompile(bytes_view code) override;
+
+  bool isCompiled(bytes_view code) override;
+
+  void setModuleCacheSize(size_t size) override { m_moduleCache.setCapacity(size); }
+
+  void setArtifactDirectory(std::string const& directory) override { m_artifactStore.setDirectory(directory); }
+
+private:
+  /// Returns the compiled module, reusing an earlier compilation of the same code
+  /// from the module cache or deserializing it from the artifact store.
+  std::shared_ptr<WasmerModule> compileModule(bytes_view code);
+
+  /// The host functions, shared by all instances.
+  std::unique_ptr<WasmerImports> m_imports;
+  ShardedLruCache<CodeHash, WasmerModule, CodeHashHasher> m_moduleCache;
+  ArtifactStore m_artifactStore;
 };
 
 }
\ No newline at end of file
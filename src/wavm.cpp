@@ -15,10 +15,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stack>
-#include <map>
+#include <string_view>
 
 #include "wavm.h"
 
@@ -33,7 +35,10 @@
 
 #include "debugging.h"
 #include "eei.h"
+#include "eei_table.h"
 #include "exceptions.h"
+#include "keccak.h"
+#include "metrics.h"
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -49,9 +54,10 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _cacheStorage
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _cacheStorage)
   {}
 
   void setWasmMemory(Runtime::MemoryInstance* _wasmMemory) {
@@ -71,6 +77,18 @@ private:
   Runtime::MemoryInstance* m_wasmMemory;
 };
 
+// The per-call parts (compartment, host module, linking) are not cached, only the compilation result.
+struct WavmCompiledModule {
+  IR::Module ir;
+  Runtime::GCPointer<Runtime::Module> module;
+  // The execution limit the maximum of the memory was lowered to (see MemoryBudget).
+  uint64_t memoryLimit = 0;
+};
+
+WavmEngine::WavmEngine():
+  m_artifactStore("wavm", HERA_WAVM_VERSION)
+{}
+
 unique_ptr<WasmEngine> WavmEngine::create()
 {
   return unique_ptr<WasmEngine>{new WavmEngine};
@@ -78,177 +96,193 @@ unique_ptr<WasmEngine> WavmEngine::create()
 
 namespace wavm_host_module {
   // first the ethereum interface(s), the top of the stack is used in host functions
-  stack<WavmEthereumInterface*> interface;
+  // The intrinsics get no user data, but are always called on the executing thread.
+  thread_local stack<WavmEthereumInterface*> interface;
 
   // the host module is called 'ethereum'
   DEFINE_INTRINSIC_MODULE(ethereum)
 
+  constexpr bool isEEIFunction(string_view name)
+  {
+    for (EEIFunction const& function: eeiFunctions)
+      if (name == function.name)
+        return true;
+    return false;
+  }
+
+  // Defines the intrinsic of an EEI function, which has to be in eeiFunctions.
+#define HERA_EEI_INTRINSIC(name, ...) \
+  static_assert(isEEIFunction(name), "Not an EEI function: " name); \
+  DEFINE_INTRINSIC_FUNCTION(ethereum, name, __VA_ARGS__)
+
   // host functions follow
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "useGas", void, useGas, I64 amount)
+  HERA_EEI_INTRINSIC("useGas", void, useGas, I64 amount)
   {
     interface.top()->eeiUseGas(amount);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getGasLeft", I64, getGasLeft)
+  HERA_EEI_INTRINSIC("getGasLeft", I64, getGasLeft)
   {
     return interface.top()->eeiGetGasLeft();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getAddress", void, getAddress, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getAddress", void, getAddress, U32 resultOffset)
   {
     interface.top()->eeiGetAddress(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getExternalBalance", void, getExternalBalance, U32 addressOffset, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getExternalBalance", void, getExternalBalance, U32 addressOffset, U32 resultOffset)
   {
     interface.top()->eeiGetExternalBalance(addressOffset, resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockHash", U32, getBlockHash, U64 number, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getBlockHash", U32, getBlockHash, U64 number, U32 resultOffset)
   {
     return interface.top()->eeiGetBlockHash(number, resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getCallDataSize", U32, getCallDataSize)
+  HERA_EEI_INTRINSIC("getCallDataSize", U32, getCallDataSize)
   {
     return interface.top()->eeiGetCallDataSize();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "callDataCopy", void, callDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
+  HERA_EEI_INTRINSIC("callDataCopy", void, callDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
   {
     interface.top()->eeiCallDataCopy(resultOffset, dataOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getCaller", void, getCaller, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getCaller", void, getCaller, U32 resultOffset)
   {
     interface.top()->eeiGetCaller(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getCallValue", void, getCallValue, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getCallValue", void, getCallValue, U32 resultOffset)
   {
     interface.top()->eeiGetCallValue(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getCodeSize", U32, getCodeSize)
+  HERA_EEI_INTRINSIC("getCodeSize", U32, getCodeSize)
   {
     return interface.top()->eeiGetCodeSize();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "codeCopy", void, codeCopy, U32 resultOffset, U32 codeOffset, U32 length)
+  HERA_EEI_INTRINSIC("codeCopy", void, codeCopy, U32 resultOffset, U32 codeOffset, U32 length)
   {
     interface.top()->eeiCodeCopy(resultOffset, codeOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getExternalCodeSize", U32, getExternalCodeSize, U32 addressOffset)
+  HERA_EEI_INTRINSIC("getExternalCodeSize", U32, getExternalCodeSize, U32 addressOffset)
   {
     return interface.top()->eeiGetExternalCodeSize(addressOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "externalCodeCopy", void, externalCodeCopy, U32 addressOffset, U32 resultOffset, U32 codeOffset, U32 length)
+  HERA_EEI_INTRINSIC("externalCodeCopy", void, externalCodeCopy, U32 addressOffset, U32 resultOffset, U32 codeOffset, U32 length)
   {
     interface.top()->eeiExternalCodeCopy(addressOffset, resultOffset, codeOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockCoinbase", void, getBlockCoinbase, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getBlockCoinbase", void, getBlockCoinbase, U32 resultOffset)
   {
     interface.top()->eeiGetBlockCoinbase(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockDifficulty", void, getBlockDifficulty, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getBlockDifficulty", void, getBlockDifficulty, U32 resultOffset)
   {
     interface.top()->eeiGetBlockDifficulty(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockGasLimit", I64, getBlockGasLimit)
+  HERA_EEI_INTRINSIC("getBlockGasLimit", I64, getBlockGasLimit)
   {
     return interface.top()->eeiGetBlockGasLimit();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getTxGasPrice", void, getTxGasPrice, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getTxGasPrice", void, getTxGasPrice, U32 resultOffset)
   {
     interface.top()->eeiGetTxGasPrice(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "log", void, log, U32 dataOffset, U32 length, U32 numberOfTopics, U32 topic1, U32 topic2, U32 topic3, U32 topic4)
+  HERA_EEI_INTRINSIC("log", void, log, U32 dataOffset, U32 length, U32 numberOfTopics, U32 topic1, U32 topic2, U32 topic3, U32 topic4)
   {
     interface.top()->eeiLog(dataOffset, length, numberOfTopics, topic1, topic2, topic3, topic4);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockNumber", I64, getBlockNumber)
+  HERA_EEI_INTRINSIC("getBlockNumber", I64, getBlockNumber)
   {
     return interface.top()->eeiGetBlockNumber();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getBlockTimestamp", I64, getBlockTimestamp)
+  HERA_EEI_INTRINSIC("getBlockTimestamp", I64, getBlockTimestamp)
   {
     return interface.top()->eeiGetBlockTimestamp();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getTxOrigin", void, getTxOrigin, U32 resultOffset)
+  HERA_EEI_INTRINSIC("getTxOrigin", void, getTxOrigin, U32 resultOffset)
   {
     interface.top()->eeiGetTxOrigin(resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "storageStore", void, storageStore, U32 pathOffset, U32 valueOffset)
+  HERA_EEI_INTRINSIC("storageStore", void, storageStore, U32 pathOffset, U32 valueOffset)
   {
     interface.top()->eeiStorageStore(pathOffset, valueOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "storageLoad", void, storageLoad, U32 pathOffset, U32 valueOffset)
+  HERA_EEI_INTRINSIC("storageLoad", void, storageLoad, U32 pathOffset, U32 valueOffset)
   {
     interface.top()->eeiStorageLoad(pathOffset, valueOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "finish", void, finish, U32 dataOffset, U32 length)
+  HERA_EEI_INTRINSIC("finish", void, finish, U32 dataOffset, U32 length)
   {
     interface.top()->eeiFinish(dataOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "revert", void, revert, U32 dataOffset, U32 length)
+  HERA_EEI_INTRINSIC("revert", void, revert, U32 dataOffset, U32 length)
   {
     interface.top()->eeiRevert(dataOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "getReturnDataSize", U32, getReturnDataSize)
+  HERA_EEI_INTRINSIC("getReturnDataSize", U32, getReturnDataSize)
   {
     return interface.top()->eeiGetReturnDataSize();
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "returnDataCopy", void, returnDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
+  HERA_EEI_INTRINSIC("returnDataCopy", void, returnDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
   {
     interface.top()->eeiReturnDataCopy(resultOffset, dataOffset, length);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "call", U32, call, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
+  HERA_EEI_INTRINSIC("call", U32, call, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
   {
     return interface.top()->eeiCall(EthereumInterface::EEICallKind::Call, gas, addressOffset, valueOffset, dataOffset, dataLength);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "callCode", U32, callCode, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
+  HERA_EEI_INTRINSIC("callCode", U32, callCode, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
   {
     return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallCode, gas, addressOffset, valueOffset, dataOffset, dataLength);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "callDelegate", U32, callDelegate, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
+  HERA_EEI_INTRINSIC("callDelegate", U32, callDelegate, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
   {
     return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallDelegate, gas, addressOffset, 0, dataOffset, dataLength);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "callStatic", U32, callStatic, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
+  HERA_EEI_INTRINSIC("callStatic", U32, callStatic, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
   {
     return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallStatic, gas, addressOffset, 0, dataOffset, dataLength);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "create", U32, create, U32 valueOffset, U32 dataOffset, U32 dataLength, U32 resultOffset)
+  HERA_EEI_INTRINSIC("create", U32, create, U32 valueOffset, U32 dataOffset, U32 dataLength, U32 resultOffset)
   {
     return interface.top()->eeiCreate(valueOffset, dataOffset, dataLength, resultOffset);
   }
 
-  DEFINE_INTRINSIC_FUNCTION(ethereum, "selfDestruct", void, selfDestruct, U32 addressOffset)
+  HERA_EEI_INTRINSIC("selfDestruct", void, selfDestruct, U32 addressOffset)
   {
     interface.top()->eeiSelfDestruct(addressOffset);
   }
 
+#undef HERA_EEI_INTRINSIC
+
   // this is needed for resolving names of imported host functions
   struct HeraWavmResolver : Runtime::Resolver {
     HashMap<string, Runtime::ModuleInstance*> moduleNameToInstanceMap;
@@ -281,6 +315,16 @@ struct WavmInterfaceKeeper {
   ~WavmInterfaceKeeper() noexcept { wavm_host_module::interface.pop(); }
 };
 
+namespace {
+// The WAVM garbage collector walks all objects of the process, so executions (which
+// create and collect objects) are serialized. Recursive, as the host may execute
+// nested calls on the same thread.
+recursive_mutex wavmRuntimeMutex;
+// Compilations only create objects held by the compiled module, so they take a lock of
+// their own and executions of cached modules go on meanwhile. Taken after wavmRuntimeMutex.
+mutex wavmCompileMutex;
+}
+
 ExecutionResult WavmEngine::execute(
   evmc::HostContext& context,
   bytes_view code,
@@ -288,12 +332,13 @@ ExecutionResult WavmEngine::execute(
   evmc_message const& msg,
   bool meterInterfaceGas
 ) {
+  lock_guard<recursive_mutex> lock{wavmRuntimeMutex};
   try {
-    instantiationStarted();
-    ExecutionResult result = internalExecute(context, code, state_code, msg, meterInterfaceGas);
+    BenchmarkTimer timer = instantiationStarted();
+    ExecutionResult result = internalExecute(context, code, state_code, msg, meterInterfaceGas, timer);
     // And clean up mess left by this run.
     Runtime::collectGarbage();
-    executionFinished();
+    timer.executionFinished(result);
     return result;
   } catch (exception const&) {
     // And clean up mess left by this run.
@@ -323,24 +368,139 @@ IR::Module WavmEngine::parseModule(bytes_view code)
   return moduleIR;
 }
 
+shared_ptr<WavmCompiledModule> WavmEngine::compileModule(bytes_view code)
+{
+  bool const useCache = m_moduleCache.capacity() > 0;
+  uint64_t const memoryLimit = memoryBudget ? memoryBudget->executionLimit() : 0;
+  CodeHash codeHash{};
+  if (useCache || m_artifactStore.enabled()) {
+    codeHash = codeHashOf(code);
+    auto cached = m_moduleCache.find(codeHash);
+    if (cached && cached->memoryLimit == memoryLimit) {
+      HERA_DEBUG << "Using cached module.\n";
+      return cached;
+    }
+  }
+
+  lock_guard<mutex> compileLock{wavmCompileMutex};
+
+  // WAVM validates while parsing.
+  PhaseTimer phases;
+  phases.start(Phase::parse);
+  auto compiled = make_shared<WavmCompiledModule>();
+  shared_ptr<IR::Module> verified = useCache ? m_verifiedModules.find(codeHash) : nullptr;
+  if (verified)
+    compiled->ir = *verified;
+  else
+    compiled->ir = parseModule(code);
+
+  // The memory is created with the maximum of the IR, so memory.grow fails beyond the limit.
+  compiled->memoryLimit = memoryLimit;
+  if (memoryLimit) {
+    for (auto& memory: compiled->ir.memories.defs)
+      memory.type.size.max = max(memory.type.size.min, memoryBudget->limitMaximum(memory.type.size.max));
+  }
+
+  phases.start(Phase::compile);
+
+  // The object code still has to be linked against the IR, but skips the LLVM compilation.
+  if (auto artifact = m_artifactStore.load(codeHash)) {
+    bytes_view objectCode = artifact->payload();
+    compiled->module = Runtime::loadPrecompiledModule(compiled->ir, vector<U8>(objectCode.begin(), objectCode.end()));
+    HERA_DEBUG << "Loaded precompiled module.\n";
+  }
+
+  if (!compiled->module) {
+    // compile the module from IR to LLVM bitcode
+    compiled->module = Runtime::compileModule(compiled->ir);
+    heraAssert(compiled->module, "Couldn't compile IR to bitcode.");
+
+    if (m_artifactStore.enabled()) {
+      vector<U8> objectCode = Runtime::getObjectCode(compiled->module);
+      m_artifactStore.save(codeHash, bytes_view{objectCode.data(), objectCode.size()});
+    }
+  }
+
+  if (useCache)
+    m_moduleCache.insert(codeHash, compiled);
+  return compiled;
+}
+
+bool WavmEngine::precompile(bytes_view code)
+{
+  if (m_moduleCache.capacity() == 0)
+    return false;
+
+  // Without the runtime lock, see wavmCompileMutex.
+  compileModule(code);
+  return true;
+}
+
+bool WavmEngine::isCompiled(bytes_view code)
+{
+  if (m_moduleCache.capacity() == 0)
+    return false;
+  auto cached = m_moduleCache.find(codeHashOf(code));
+  return cached && cached->memoryLimit == (memoryBudget ? memoryBudget->executionLimit() : 0);
+}
+
+namespace {
+IR::ValueType toWavmType(EEIValueType type)
+{
+  heraAssert(type != EEIValueType::none, "EEI parameters and results have a type.");
+  return (type == EEIValueType::i64) ? IR::ValueType::i64 : IR::ValueType::i32;
+}
+
+IR::FunctionType toWavmFunctionType(EEIFunction const& function)
+{
+  vector<IR::ValueType> results;
+  if (function.result != EEIValueType::none)
+    results.push_back(toWavmType(function.result));
+  vector<IR::ValueType> params;
+  for (size_t i = 0; i < function.paramCount; ++i)
+    params.push_back(toWavmType(function.params[i]));
+  return IR::FunctionType{IR::TypeTuple{results}, IR::TypeTuple{params}};
+}
+
+// The intrinsics are listed by hand. Each is checked to be an EEI function when compiling
+// (see HERA_EEI_INTRINSIC), and this checks that every EEI function is an intrinsic with
+// the same signature.
+bool checkIntrinsics(Runtime::ModuleInstance* hostModule)
+{
+  for (EEIFunction const& function: eeiFunctions) {
+    Runtime::Object* intrinsic = Runtime::getInstanceExport(hostModule, function.name);
+    heraAssert(
+      intrinsic && isA(intrinsic, toWavmFunctionType(function)),
+      string{"WAVM intrinsic does not match the EEI function "} + function.name + "."
+    );
+  }
+  return true;
+}
+}
+
 ExecutionResult WavmEngine::internalExecute(
   evmc::HostContext& context,
   bytes_view code,
   bytes_view state_code,
   evmc_message const& msg,
-  bool meterInterfaceGas
+  bool meterInterfaceGas,
+  BenchmarkTimer& timer
 ) {
   HERA_DEBUG << "Executing with wavm...\n";
 
-  IR::Module moduleIR = parseModule(code);
+  shared_ptr<WavmCompiledModule> compiled = compileModule(code);
+
+  PhaseTimer phases;
+  phases.start(Phase::instantiate);
 
   // set up a new ethereum interface just for this contract invocation
   ExecutionResult result;
-  WavmEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
+  WavmEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas, storageCacheEnabled};
   WavmInterfaceKeeper interfaceKeeper{interface};
 
   // next set up the VM
-  // Note: in ewasm, we create a new VM for each call to a module, so we must instantiate a new host module for each of these VMs, this is inefficient, but OK for prototyping.
+  // Note: in ewasm, we create a new VM for each call to a module, so we must instantiate a new host module for each of these VMs.
+  // Only the compiled module is reused across calls (see compileModule).
 
   // compartment is like the Wasm store, represents the VM, has lists of globals, memories, tables, and also has wavm's runtime stuff
   Runtime::GCPointer<Runtime::Compartment> compartment = Runtime::createCompartment();
@@ -348,20 +508,17 @@ ExecutionResult WavmEngine::internalExecute(
   // instantiate host Module
   Runtime::GCPointer<Runtime::ModuleInstance> ethereumHostModule = Intrinsics::instantiateModule(compartment, wavm_host_module::INTRINSIC_MODULE_REF(ethereum), "ethereum", {});
   heraAssert(ethereumHostModule, "Failed to create host module.");
+  static bool const intrinsicsChecked = checkIntrinsics(ethereumHostModule);
 
   // prepare contract module to resolve links against host module
   wavm_host_module::HeraWavmResolver resolver;
   // TODO: move this into the constructor?
   resolver.moduleNameToInstanceMap.set("ethereum", ethereumHostModule);
-  Runtime::LinkResult linkResult = Runtime::linkModule(moduleIR, resolver);
+  Runtime::LinkResult linkResult = Runtime::linkModule(compiled->ir, resolver);
   ensureCondition(linkResult.success, ContractValidationFailure, "Couldn't link contract against host module.");
 
-  // compile the module from IR to LLVM bitcode
-  Runtime::GCPointer<Runtime::Module> module = Runtime::compileModule(moduleIR);
-  heraAssert(module, "Couldn't compile IR to bitcode.");
-
   // instantiate contract module
-  Runtime::GCPointer<Runtime::ModuleInstance> moduleInstance = Runtime::instantiateModule(compartment, module, move(linkResult.resolvedImports), "<ewasmcontract>");
+  Runtime::GCPointer<Runtime::ModuleInstance> moduleInstance = Runtime::instantiateModule(compartment, compiled->module, move(linkResult.resolvedImports), "<ewasmcontract>");
   heraAssert(moduleInstance, "Couldn't instantiate contact module.");
 
   ensureCondition(!Runtime::getStartFunction(moduleInstance), ContractValidationFailure, "Contract contains start function.");
@@ -375,11 +532,17 @@ ExecutionResult WavmEngine::internalExecute(
   // get memory for easy access in host functions
   wavm_host_module::interface.top()->setWasmMemory(memory);
 
+  uint64_t maximumPages = maxWasmPages;
+  if (!compiled->ir.memories.defs.empty())
+    maximumPages = compiled->ir.memories.defs[0].type.size.max;
+  MemoryReservation reservation{memoryBudget, Runtime::getMemoryNumPages(memory), maximumPages};
+
   // invoke the main function
   Runtime::GCPointer<Runtime::FunctionInstance> mainFunction = asFunctionNullable(Runtime::getInstanceExport(moduleInstance, "main"));
   ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
 
-  executionStarted();
+  timer.executionStarted();
+  phases.start(Phase::execute);
 
   // this is how WAVM's try/catch for exceptions
   Runtime::catchRuntimeExceptions(
@@ -404,7 +567,8 @@ ExecutionResult WavmEngine::internalExecute(
 
 void WavmEngine::verifyContract(bytes_view code)
 {
-  IR::Module moduleIR = parseModule(code);
+  auto verified = make_shared<IR::Module>(parseModule(code));
+  IR::Module const& moduleIR = *verified;
 
   ensureCondition(moduleIR.startFunctionIndex == UINTPTR_MAX, ContractValidationFailure, "Contract contains start function.");
 
@@ -419,42 +583,6 @@ void WavmEngine::verifyContract(bytes_view code)
     }
   }
 
-  static const map<string const, IR::FunctionType const> eei_signatures{
-    { "useGas", IR::FunctionType{ {}, { IR::ValueType::i64 } } },
-    { "getGasLeft", IR::FunctionType{ { IR::ValueType::i64 }, {} } },
-    { "getAddress", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "getExternalBalance", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getBlockHash", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i64, IR::ValueType::i32 } } },
-    { "getCallDataSize", IR::FunctionType{ { IR::ValueType::i32 }, {} } },
-    { "callDataCopy", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getCaller", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "getCallValue", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "codeCopy", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getCodeSize", IR::FunctionType{ { IR::ValueType::i32 }, {} } },
-    { "externalCodeCopy", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getExternalCodeSize", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i32 } } },
-    { "getBlockCoinbase", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "getBlockDifficulty", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "getBlockGasLimit", IR::FunctionType{ { IR::ValueType::i64 }, {} } },
-    { "getTxGasPrice", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "log", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getBlockNumber", IR::FunctionType{ { IR::ValueType::i64 }, {} } },
-    { "getBlockTimestamp", IR::FunctionType{ { IR::ValueType::i64 }, {} } },
-    { "getTxOrigin", IR::FunctionType{ {}, { IR::ValueType::i32 } } },
-    { "storageStore", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "storageLoad", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "finish", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "revert", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "getReturnDataSize", IR::FunctionType{ { IR::ValueType::i32 }, {} } },
-    { "returnDataCopy", IR::FunctionType{ {}, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "call", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i64, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "callCode", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i64, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "callDelegate", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i64, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "callStatic", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i64, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "create", IR::FunctionType{ { IR::ValueType::i32 }, { IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32, IR::ValueType::i32 } } },
-    { "selfDestruct", IR::FunctionType{ {}, { IR::ValueType::i32 } } }
-  };
-
   for (auto const& import: moduleIR.functions.imports) {
 #if HERA_DEBUGGING
     if (import.moduleName == "debug")
@@ -467,12 +595,13 @@ void WavmEngine::verifyContract(bytes_view code)
       "Import from invalid namespace."
     );
 
+    EEIFunction const* eei_function = findEEIFunction(import.exportName);
     ensureCondition(
-      eei_signatures.count(import.exportName),
+      eei_function,
       ContractValidationFailure,
       "Importing invalid EEI method."
     );
-    IR::FunctionType const& eei_function_type = eei_signatures.at(import.exportName);
+    IR::FunctionType eei_function_type = toWavmFunctionType(*eei_function);
 
     ensureCondition(
       moduleIR.types.size() > import.type.index,
@@ -487,6 +616,10 @@ void WavmEngine::verifyContract(bytes_view code)
       "Imported function type mismatch."
     );
   }
+
+  // Keep the parsed module, so the first execution of the contract only has to compile it.
+  if (m_verifiedModules.capacity() > 0)
+    m_verifiedModules.insert(codeHashOf(code), move(verified));
 }
 
 } // namespace hera
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include "artifact_store.h"
+#include "cache.h"
 #include "eei.h"
 
 namespace IR {
@@ -25,8 +27,12 @@ class Module;
 
 namespace hera {
 
+struct WavmCompiledModule;
+
 class WavmEngine : public WasmEngine {
 public:
+  WavmEngine();
+
   /// Factory method to create the WAVM Wasm Engine.
   static std::unique_ptr<WasmEngine> create();
 
@@ -40,16 +46,38 @@ public:
 
   void verifyContract(bytes_view code) override;
 
+  bool precompile(bytes_view code) override;
+
+  bool isCompiled(bytes_view code) override;
+
+  void setModuleCacheSize(size_t size) override
+  {
+    m_moduleCache.setCapacity(size);
+    m_verifiedModules.setCapacity(size);
+  }
+
+  void setArtifactDirectory(std::string const& directory) override { m_artifactStore.setDirectory(directory); }
+
 private:
   ExecutionResult internalExecute(
     evmc::HostContext& context,
     bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    BenchmarkTimer& timer
   );
 
   IR::Module parseModule(bytes_view code);
+
+  /// Returns the parsed and compiled module, reusing an earlier compilation of the same code
+  /// from the module cache or the artifact store.
+  std::shared_ptr<WavmCompiledModule> compileModule(bytes_view code);
+
+  ShardedLruCache<CodeHash, WavmCompiledModule, CodeHashHasher> m_moduleCache;
+  /// Modules parsed by verifyContract, which have not been compiled yet.
+  ShardedLruCache<CodeHash, IR::Module, CodeHashHasher> m_verifiedModules;
+  ArtifactStore m_artifactStore;
 };
 
 } // namespace hera
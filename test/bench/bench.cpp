@@ -0,0 +1,392 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs a corpus of ewasm contracts through every requested engine, using a mocked host,
+// and reports latency percentiles, throughput, allocations and the time spent per phase.
+//
+// The corpus is a directory of `<name>.wasm` contracts (as deployed), each optionally
+// accompanied by `<name>.calldata` holding the call data in hex. Contracts are run in
+// alphabetical order and every execution starts from an empty state, so runs are
+// repeatable and comparable across builds.
+
+#include <hera/hera.h>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+#include "../mocked_host.h"
+
+using namespace std;
+
+namespace {
+
+atomic<uint64_t> allocations{0};
+
+}
+
+// Counts the allocations of the whole process, including Hera and the engines.
+// Allocations of Wasmer (made by Rust) are not seen.
+void* operator new(size_t size)
+{
+  allocations.fetch_add(1, memory_order_relaxed);
+  if (void* ret = malloc(size ? size : 1))
+    return ret;
+  throw bad_alloc{};
+}
+
+void operator delete(void* pointer) noexcept
+{
+  free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+  free(pointer);
+}
+
+namespace {
+
+using hera::test::bytes;
+using hera::test::callerAddress;
+using hera::test::contractAddress;
+using hera::test::MockedHost;
+
+struct Contract {
+  string name;
+  bytes code;
+  bytes callData;
+};
+
+struct Options {
+  vector<string> engines;
+  vector<pair<string, string>> heraOptions;
+  unsigned iterations = 100;
+  unsigned warmup = 1;
+  unsigned threads = 1;
+  int64_t gas = 100000000;
+  bool csv = false;
+  string corpus;
+};
+
+// Per phase: the number of times it was measured and its total duration in seconds.
+using PhaseTotals = map<string, pair<double, double>>;
+
+[[noreturn]] void usage(char const* program)
+{
+  cerr << "Usage: " << program << " [options] <corpus directory>\n"
+       << "  --engine <name>        engine to benchmark, may be repeated (default: all available)\n"
+       << "  --option <name=value>  Hera option to set on every instance, may be repeated\n"
+       << "  --iterations <n>       measured executions per contract (default: 100)\n"
+       << "  --warmup <n>           unmeasured executions per contract first (default: 1)\n"
+       << "  --threads <n>          threads executing concurrently on one instance (default: 1)\n"
+       << "  --gas <n>              gas of every execution (default: 100000000)\n"
+       << "  --csv                  print the results as CSV\n";
+  exit(1);
+}
+
+bytes readFile(string const& path)
+{
+  ifstream file{path, ios::binary};
+  if (!file)
+    throw runtime_error("Cannot read " + path);
+  string content{istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+  return bytes{content.begin(), content.end()};
+}
+
+bytes parseHex(bytes const& text, string const& path)
+{
+  string digits;
+  for (uint8_t c: text)
+    if (!isspace(c))
+      digits.push_back(static_cast<char>(c));
+  if (digits.compare(0, 2, "0x") == 0)
+    digits.erase(0, 2);
+  if (digits.size() % 2 != 0 || digits.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+    throw runtime_error("Invalid hex in " + path);
+
+  bytes ret;
+  for (size_t i = 0; i < digits.size(); i += 2)
+    ret.push_back(static_cast<uint8_t>(stoul(digits.substr(i, 2), nullptr, 16)));
+  return ret;
+}
+
+vector<Contract> loadCorpus(string const& directory)
+{
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+    throw runtime_error("Cannot open corpus directory " + directory);
+  vector<string> names;
+  while (dirent* entry = readdir(dir)) {
+    string file = entry->d_name;
+    if (file.size() > 5 && file.compare(file.size() - 5, 5, ".wasm") == 0)
+      names.push_back(file.substr(0, file.size() - 5));
+  }
+  closedir(dir);
+  sort(names.begin(), names.end());
+
+  vector<Contract> ret;
+  for (auto const& name: names) {
+    Contract contract{name, readFile(directory + "/" + name + ".wasm"), {}};
+    string callDataPath = directory + "/" + name + ".calldata";
+    if (ifstream{callDataPath})
+      contract.callData = parseHex(readFile(callDataPath), callDataPath);
+    ret.push_back(move(contract));
+  }
+  return ret;
+}
+
+// The phase timings are taken from the metrics of Hera (in the Prometheus text format).
+PhaseTotals phaseTotals()
+{
+  size_t size = hera_dump_metrics("prometheus", nullptr, 0);
+  string dump(size + 1, '\0');
+  hera_dump_metrics("prometheus", &dump[0], dump.size());
+
+  PhaseTotals ret;
+  istringstream lines{dump};
+  string metricPrefix = "hera_phase_duration_seconds_";
+  for (string line; getline(lines, line);) {
+    if (line.compare(0, metricPrefix.size(), metricPrefix) != 0)
+      continue;
+    size_t labelStart = line.find("phase=\"");
+    size_t labelEnd = line.find('"', labelStart + 7);
+    if (labelStart == string::npos || labelEnd == string::npos)
+      continue;
+    string phase = line.substr(labelStart + 7, labelEnd - labelStart - 7);
+    double value = stod(line.substr(line.rfind(' ') + 1));
+    if (line.compare(metricPrefix.size(), 4, "sum{") == 0)
+      ret[phase].second = value;
+    else if (line.compare(metricPrefix.size(), 6, "count{") == 0)
+      ret[phase].first = value;
+  }
+  return ret;
+}
+
+struct Measurement {
+  vector<double> latencies; // in microseconds
+  double wallSeconds = 0;
+  uint64_t allocations = 0;
+  unsigned failures = 0;
+  PhaseTotals phases;
+};
+
+bool execute(evmc_vm* vm, Contract const& contract, int64_t gas)
+{
+  // Not journaling, which would allocate during the measurement.
+  MockedHost host{contract.code, false};
+  evmc_message msg{};
+  msg.kind = EVMC_CALL;
+  msg.gas = gas;
+  msg.destination = contractAddress;
+  msg.sender = callerAddress;
+  msg.input_data = contract.callData.data();
+  msg.input_size = contract.callData.size();
+
+  evmc::result result{vm->execute(
+    vm, &evmc::Host::get_interface(), host.to_context(), EVMC_BYZANTIUM, &msg, contract.code.data(), contract.code.size()
+  )};
+  return result.status_code == EVMC_SUCCESS || result.status_code == EVMC_REVERT;
+}
+
+Measurement measure(evmc_vm* vm, Contract const& contract, Options const& options)
+{
+  for (unsigned i = 0; i < options.warmup; ++i)
+    execute(vm, contract, options.gas);
+
+  Measurement ret;
+  PhaseTotals phasesBefore = phaseTotals();
+  uint64_t allocationsBefore = allocations.load();
+  vector<vector<double>> latencies(options.threads);
+  atomic<unsigned> failures{0};
+  atomic<unsigned> next{0};
+
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (unsigned t = 0; t < options.threads; ++t)
+    threads.emplace_back([&, t] {
+      while (next.fetch_add(1) < options.iterations) {
+        auto executionStart = chrono::steady_clock::now();
+        if (!execute(vm, contract, options.gas))
+          ++failures;
+        latencies[t].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - executionStart).count());
+      }
+    });
+  for (auto& t: threads)
+    t.join();
+  ret.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  ret.allocations = allocations.load() - allocationsBefore;
+  ret.failures = failures;
+
+  for (auto& l: latencies)
+    ret.latencies.insert(ret.latencies.end(), l.begin(), l.end());
+  sort(ret.latencies.begin(), ret.latencies.end());
+
+  ret.phases = phaseTotals();
+  for (auto& phase: ret.phases) {
+    phase.second.first -= phasesBefore[phase.first].first;
+    phase.second.second -= phasesBefore[phase.first].second;
+  }
+  return ret;
+}
+
+double percentile(vector<double> const& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+void report(Options const& options, string const& engine, Contract const& contract, Measurement const& m)
+{
+  double runs = static_cast<double>(m.latencies.size());
+  double throughput = m.wallSeconds > 0 ? runs / m.wallSeconds : 0;
+  double allocationsPerRun = runs > 0 ? static_cast<double>(m.allocations) / runs : 0;
+
+  if (options.csv) {
+    cout << engine << ',' << contract.name << ',' << m.latencies.size() << ',' << m.failures << ','
+         << fixed << setprecision(3) << percentile(m.latencies, 0.5) << ',' << percentile(m.latencies, 0.99) << ','
+         << throughput << ',' << allocationsPerRun;
+    for (auto const& phase: {"parse", "validate", "compile", "instantiate", "execute"}) {
+      auto it = m.phases.find(phase);
+      double seconds = it != m.phases.end() ? it->second.second : 0;
+      cout << ',' << (runs > 0 ? seconds * 1e6 / runs : 0);
+    }
+    cout << '\n';
+    return;
+  }
+
+  cout << left << setw(10) << engine << setw(24) << contract.name << right << fixed << setprecision(1)
+       << " runs " << m.latencies.size() << " failures " << m.failures
+       << "  p50 " << percentile(m.latencies, 0.5) << " us  p99 " << percentile(m.latencies, 0.99)
+       << " us  " << throughput << " exec/s  " << allocationsPerRun << " allocs/exec\n";
+  for (auto const& phase: m.phases) {
+    if (phase.second.first <= 0)
+      continue;
+    cout << "    " << left << setw(12) << phase.first << right << setprecision(1)
+         << phase.second.first / m.wallSeconds << " /s  " << setprecision(2)
+         << phase.second.second * 1e6 / phase.second.first << " us avg\n";
+  }
+}
+
+Options parseOptions(int argc, char** argv)
+{
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    auto value = [&]() -> string {
+      if (i + 1 >= argc)
+        usage(argv[0]);
+      return argv[++i];
+    };
+    auto number = [&]() -> unsigned long long {
+      string v = value();
+      char* end = nullptr;
+      unsigned long long n = strtoull(v.c_str(), &end, 10);
+      if (v.empty() || *end != '\0')
+        usage(argv[0]);
+      return n;
+    };
+
+    if (arg == "--engine")
+      options.engines.push_back(value());
+    else if (arg == "--option") {
+      string option = value();
+      size_t separator = option.find('=');
+      if (separator == string::npos)
+        usage(argv[0]);
+      options.heraOptions.emplace_back(option.substr(0, separator), option.substr(separator + 1));
+    } else if (arg == "--iterations")
+      options.iterations = static_cast<unsigned>(number());
+    else if (arg == "--warmup")
+      options.warmup = static_cast<unsigned>(number());
+    else if (arg == "--threads")
+      options.threads = max(1u, static_cast<unsigned>(number()));
+    else if (arg == "--gas")
+      options.gas = static_cast<int64_t>(number());
+    else if (arg == "--csv")
+      options.csv = true;
+    else if (!arg.empty() && arg[0] != '-' && options.corpus.empty())
+      options.corpus = arg;
+    else
+      usage(argv[0]);
+  }
+  if (options.corpus.empty())
+    usage(argv[0]);
+  if (options.engines.empty())
+    options.engines = {"binaryen", "wabt", "wavm", "wasmer"};
+  return options;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  Options options = parseOptions(argc, argv);
+
+  vector<Contract> corpus;
+  try {
+    corpus = loadCorpus(options.corpus);
+  } catch (exception const& e) {
+    cerr << e.what() << "\n";
+    return 1;
+  }
+  if (corpus.empty()) {
+    cerr << "No contracts found in " << options.corpus << "\n";
+    return 1;
+  }
+
+  if (options.csv)
+    cout << "engine,contract,runs,failures,p50_us,p99_us,exec_per_s,allocs_per_exec,"
+            "parse_us,validate_us,compile_us,instantiate_us,execute_us\n";
+
+  for (auto const& engine: options.engines) {
+    evmc_vm* vm = evmc_create_hera();
+    if (vm->set_option(vm, "engine", engine.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Engine " << engine << " is not available, skipped.\n";
+      vm->destroy(vm);
+      continue;
+    }
+    vm->set_option(vm, "metrics", "true");
+    for (auto const& option: options.heraOptions)
+      if (vm->set_option(vm, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+        cerr << "Invalid option " << option.first << "=" << option.second << "\n";
+        return 1;
+      }
+
+    for (auto const& contract: corpus)
+      report(options, engine, contract, measure(vm, contract, options));
+    vm->destroy(vm);
+  }
+  return 0;
+}
@@ -0,0 +1,13 @@
+;; Returns the call data.
+(module
+  (import "ethereum" "getCallDataSize" (func $getCallDataSize (result i32)))
+  (import "ethereum" "callDataCopy" (func $callDataCopy (param i32 i32 i32)))
+  (import "ethereum" "finish" (func $finish (param i32 i32)))
+  (memory 1)
+  (export "main" (func $main))
+  (export "memory" (memory 0))
+  (func $main
+    (local $size i32)
+    (local.set $size (call $getCallDataSize))
+    (call $callDataCopy (i32.const 0) (i32.const 0) (local.get $size))
+    (call $finish (i32.const 0) (local.get $size))))
@@ -0,0 +1,13 @@
+;; Pure computation: 100000 iterations of i64 arithmetic, no host functions.
+(module
+  (memory 1)
+  (export "main" (func $main))
+  (export "memory" (memory 0))
+  (func $main
+    (local $counter i32)
+    (local $acc i64)
+    (local.set $counter (i32.const 100000))
+    (loop $continue
+      (local.set $acc (i64.add (i64.mul (local.get $acc) (i64.const 3)) (i64.const 1)))
+      (br_if $continue (local.tee $counter (i32.sub (local.get $counter) (i32.const 1)))))
+    (i64.store (i32.const 0) (local.get $acc))))
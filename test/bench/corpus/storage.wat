@@ -0,0 +1,15 @@
+;; 100 rounds of storing a changing value to a single key and loading it back.
+(module
+  (import "ethereum" "storageStore" (func $storageStore (param i32 i32)))
+  (import "ethereum" "storageLoad" (func $storageLoad (param i32 i32)))
+  (memory 1)
+  (export "main" (func $main))
+  (export "memory" (memory 0))
+  (func $main
+    (local $counter i32)
+    (local.set $counter (i32.const 100))
+    (loop $continue
+      (i32.store (i32.const 32) (local.get $counter))
+      (call $storageStore (i32.const 0) (i32.const 32))
+      (call $storageLoad (i32.const 0) (i32.const 64))
+      (br_if $continue (local.tee $counter (i32.sub (local.get $counter) (i32.const 1)))))))
@@ -14,59 +14,225 @@
  * limitations under the License.
  */
 
+// Executes every input as contract code on all engines of the build and checks that they
+// agree on the status, gas left, output and the effects on the (mocked) host. Only these
+// deterministic disagreements are crashes. Inputs taking far longer on one engine than on
+// the fastest one are reported as performance bugs, but timings are not reproducible, so
+// they only crash if HERA_FUZZ_SLOW_TRAP is set.
+//
+// The environment variables HERA_FUZZ_SLOW_FACTOR (default 100) and HERA_FUZZ_SLOW_MS
+// (default 100) set how many times slower than the fastest engine, and at least how many
+// milliseconds, an execution has to take to be reported. If HERA_FUZZ_SLOW_DIR is set,
+// slow inputs are written to that directory. HERA_FUZZ_OPTIONS holds Hera options set on
+// every engine, separated by spaces, e.g. "metering=native memory-limit=16".
+
 #include <hera/hera.h>
-#include <evmc/helpers.h>
-#include <initializer_list>
-#include <utility>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+#include "../mocked_host.h"
+
+namespace
+{
+using hera::test::bytes;
+using hera::test::callerAddress;
+using hera::test::contractAddress;
+using hera::test::MockedHost;
+
+// A contract with an empty main, executed once by every engine before fuzzing, so that the
+// one-time initialization of an engine is not taken for slowness.
+constexpr uint8_t warmUpCode[] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x04, 0x01,
+    0x60, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0x05, 0x03, 0x01, 0x00, 0x01, 0x07, 0x11, 0x02, 0x04,
+    'm', 'a', 'i', 'n', 0x00, 0x00, 0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x00, 0x0a, 0x04,
+    0x01, 0x02, 0x00, 0x0b};
+
+struct Outcome
+{
+    evmc_status_code status = EVMC_INTERNAL_ERROR;
+    int64_t gasLeft = 0;
+    bytes output;
+    bytes journal;
+    std::chrono::nanoseconds duration{0};
+};
 
 class Hera
 {
 public:
     ~Hera() noexcept { m_instance->destroy(m_instance); }
 
-    Hera(std::initializer_list<std::pair<const char*, const char*>> options)
-      : m_instance{evmc_create_hera()}
+    explicit Hera(const char* engine) : m_engine{engine}, m_instance{evmc_create_hera()}
     {
-        for (auto option : options)
-            evmc_set_option(m_instance, option.first, option.second);
+        m_available = evmc_set_option(m_instance, "engine", engine) == EVMC_SET_OPTION_SUCCESS;
+        if (m_available)
+            setOptions(std::getenv("HERA_FUZZ_OPTIONS"));
     }
 
-    evmc_result execute(
-        evmc_revision rev, const evmc_message& msg, const uint8_t* code, size_t code_size) noexcept
+    Hera(const Hera&) = delete;
+    Hera& operator=(const Hera&) = delete;
+
+    bool available() const noexcept { return m_available; }
+    const char* engine() const noexcept { return m_engine; }
+
+    Outcome execute(evmc_revision rev, const evmc_message& msg, const uint8_t* code, size_t code_size)
     {
-        return m_instance->execute(m_instance, nullptr, rev, &msg, code, code_size);
+        MockedHost host{{code, code_size}, true};
+        auto start = std::chrono::steady_clock::now();
+        evmc::result result{m_instance->execute(
+            m_instance, &evmc::Host::get_interface(), host.to_context(), rev, &msg, code, code_size)};
+        Outcome outcome;
+        outcome.duration = std::chrono::steady_clock::now() - start;
+        outcome.status = result.status_code;
+        outcome.gasLeft = result.gas_left;
+        if (result.output_size)
+            outcome.output.assign(result.output_data, result.output_size);
+        outcome.journal = host.journal();
+        return outcome;
     }
 
 private:
-    evmc_instance* const m_instance = nullptr;
+    // Sets the "name=value" pairs in @options, aborting on any the engine rejects.
+    void setOptions(const char* options)
+    {
+        std::istringstream stream{options ? options : ""};
+        std::string option;
+        while (stream >> option)
+        {
+            size_t separator = option.find('=');
+            std::string name = option.substr(0, separator);
+            std::string value = separator == std::string::npos ? "" : option.substr(separator + 1);
+            if (evmc_set_option(m_instance, name.c_str(), value.c_str()) != EVMC_SET_OPTION_SUCCESS)
+            {
+                std::fprintf(stderr, "Invalid option %s for %s\n", option.c_str(), m_engine);
+                std::abort();
+            }
+        }
+    }
+
+    const char* const m_engine;
+    evmc_vm* const m_instance = nullptr;
+    bool m_available = false;
 };
 
-inline void expect(bool test) noexcept
+double environmentNumber(const char* name, double defaultValue) noexcept
+{
+    const char* value = std::getenv(name);
+    return value ? std::atof(value) : defaultValue;
+}
+
+const std::vector<std::unique_ptr<Hera>>& engines()
+{
+    static const std::vector<std::unique_ptr<Hera>> ret = [] {
+        std::vector<std::unique_ptr<Hera>> available;
+        for (const char* engine : {"binaryen", "wabt", "wavm", "wasmer"})
+        {
+            auto hera = std::make_unique<Hera>(engine);
+            if (!hera->available())
+                continue;
+            evmc_message msg{};
+            msg.kind = EVMC_CALL;
+            msg.gas = 100000;
+            msg.destination = contractAddress;
+            hera->execute(EVMC_BYZANTIUM, msg, warmUpCode, sizeof(warmUpCode));
+            available.push_back(std::move(hera));
+        }
+        return available;
+    }();
+    return ret;
+}
+
+void report(const char* what, const std::vector<Outcome>& outcomes)
+{
+    std::fprintf(stderr, "%s\n", what);
+    for (size_t i = 0; i < outcomes.size(); ++i)
+        std::fprintf(stderr, "  %-8s status %d, gas left %lld, output %zu bytes, journal %zu bytes, %.3f ms\n",
+            engines()[i]->engine(), outcomes[i].status, static_cast<long long>(outcomes[i].gasLeft),
+            outcomes[i].output.size(), outcomes[i].journal.size(),
+            std::chrono::duration<double, std::milli>(outcomes[i].duration).count());
+}
+
+inline void expect(bool test, const char* what, const std::vector<Outcome>& outcomes) noexcept
 {
     if (!test)
+    {
+        report(what, outcomes);
         __builtin_trap();
+    }
+}
+
+// Writes @input to HERA_FUZZ_SLOW_DIR, named by its FNV-1a hash so that it is kept once.
+void saveSlowInput(const uint8_t* input, size_t size) noexcept
+{
+    static const char* directory = std::getenv("HERA_FUZZ_SLOW_DIR");
+    if (!directory)
+        return;
+
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ input[i]) * 0x100000001b3;
+
+    std::string path = std::string{directory} + "/slow-";
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    path += name;
+    if (std::FILE* file = std::fopen(path.c_str(), "wb"))
+    {
+        std::fwrite(input, 1, size, file);
+        std::fclose(file);
+        std::fprintf(stderr, "  saved as %s\n", path.c_str());
+    }
 }
+}  // namespace
 
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* input, size_t size)
 {
-    Hera heraBinaryen{{"engine", "binaryen"}};
-    Hera heraWabt{{"engine", "wabt"}};
+    static const double slowFactor = environmentNumber("HERA_FUZZ_SLOW_FACTOR", 100);
+    static const std::chrono::duration<double, std::milli> slowMinimum{
+        environmentNumber("HERA_FUZZ_SLOW_MS", 100)};
 
     evmc_message msg{};
     msg.kind = EVMC_CREATE;
     msg.gas = 100000;
+    msg.destination = contractAddress;
+    msg.sender = callerAddress;
 
-    auto resBinaryen = heraBinaryen.execute(EVMC_BYZANTIUM, msg, input, size);
-    auto resWabt = heraBinaryen.execute(EVMC_BYZANTIUM, msg, input, size);
+    std::vector<Outcome> outcomes;
+    for (const auto& hera : engines())
+        outcomes.push_back(hera->execute(EVMC_BYZANTIUM, msg, input, size));
+    if (outcomes.empty())
+        return 0;
 
-    expect(resBinaryen.gas_left == resWabt.gas_left);
-    expect(resBinaryen.output_size == resWabt.output_size);
-    expect(resBinaryen.status_code == resWabt.status_code);
+    const Outcome& first = outcomes.front();
+    auto fastest = first.duration;
+    for (const Outcome& outcome : outcomes)
+    {
+        expect(outcome.status == first.status, "Engines disagree on the status.", outcomes);
+        expect(outcome.gasLeft == first.gasLeft, "Engines disagree on the gas left.", outcomes);
+        expect(outcome.output == first.output, "Engines disagree on the output.", outcomes);
+        expect(outcome.journal == first.journal, "Engines disagree on the state changes.", outcomes);
+        fastest = std::min(fastest, outcome.duration);
+    }
 
-    if (resBinaryen.release)
-        resBinaryen.release(&resBinaryen);
-    if (resWabt.release)
-        resWabt.release(&resWabt);
+    static const bool slowTrap = std::getenv("HERA_FUZZ_SLOW_TRAP") != nullptr;
+    for (const Outcome& outcome : outcomes)
+    {
+        if (outcome.duration < slowMinimum || outcome.duration < fastest * slowFactor)
+            continue;
+        report("An engine is pathologically slow.", outcomes);
+        saveSlowInput(input, size);
+        if (slowTrap)
+            __builtin_trap();
+        break;
+    }
 
     return 0;
 }
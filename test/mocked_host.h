@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <evmc/evmc.hpp>
+
+namespace hera::test {
+
+using bytes = std::basic_string<uint8_t>;
+using bytes_view = std::basic_string_view<uint8_t>;
+
+using namespace evmc::literals;
+
+constexpr evmc::address contractAddress = 0x000000000000000000000000000000000000c0de_address;
+constexpr evmc::address callerAddress = 0x00000000000000000000000000000000000ca11e_address;
+
+/// An empty state, where only the executed contract exists and nested calls succeed without
+/// doing anything. The code stays owned by the caller.
+///
+/// If journaling, everything the contract does to the state is appended to the journal, e.g.
+/// for comparing engines. Otherwise nothing is recorded, so executions do not allocate for it.
+class MockedHost : public evmc::Host {
+public:
+  MockedHost(bytes_view code, bool journaling) noexcept: m_code(code), m_journaling(journaling) {}
+
+  bool account_exists(evmc::address const& addr) noexcept override { return addr == contractAddress; }
+
+  evmc::bytes32 get_storage(evmc::address const& addr, evmc::bytes32 const& key) noexcept override
+  {
+    auto it = m_storage.find(std::make_pair(addr, key));
+    return it != m_storage.end() ? it->second : evmc::bytes32{};
+  }
+
+  evmc_storage_status set_storage(evmc::address const& addr, evmc::bytes32 const& key, evmc::bytes32 const& value) noexcept override
+  {
+    record('S', addr.bytes, sizeof(addr.bytes));
+    record(key.bytes, sizeof(key.bytes));
+    record(value.bytes, sizeof(value.bytes));
+    evmc::bytes32& slot = m_storage[std::make_pair(addr, key)];
+    evmc_storage_status status = slot == value ? EVMC_STORAGE_UNCHANGED : EVMC_STORAGE_MODIFIED;
+    slot = value;
+    return status;
+  }
+
+  evmc::uint256be get_balance(evmc::address const&) noexcept override { return {}; }
+
+  size_t get_code_size(evmc::address const& addr) noexcept override { return addr == contractAddress ? m_code.size() : 0; }
+
+  evmc::bytes32 get_code_hash(evmc::address const&) noexcept override { return {}; }
+
+  size_t copy_code(evmc::address const& addr, size_t code_offset, uint8_t* buffer_data, size_t buffer_size) noexcept override
+  {
+    if (addr != contractAddress || code_offset >= m_code.size())
+      return 0;
+    return m_code.copy(buffer_data, buffer_size, code_offset);
+  }
+
+  void selfdestruct(evmc::address const& addr, evmc::address const& beneficiary) noexcept override
+  {
+    record('D', addr.bytes, sizeof(addr.bytes));
+    record(beneficiary.bytes, sizeof(beneficiary.bytes));
+  }
+
+  evmc::result call(evmc_message const& msg) noexcept override
+  {
+    record('C', msg.destination.bytes, sizeof(msg.destination.bytes));
+    record(msg.value.bytes, sizeof(msg.value.bytes));
+    record(reinterpret_cast<uint8_t const*>(&msg.kind), sizeof(msg.kind));
+    record(msg.input_data, msg.input_size);
+    return evmc::result{EVMC_SUCCESS, msg.gas, nullptr, 0};
+  }
+
+  evmc_tx_context get_tx_context() noexcept override
+  {
+    evmc_tx_context context{};
+    context.tx_origin = callerAddress;
+    context.block_number = 1;
+    context.block_timestamp = 1;
+    context.block_gas_limit = 10000000;
+    return context;
+  }
+
+  evmc::bytes32 get_block_hash(int64_t) noexcept override { return {}; }
+
+  void emit_log(evmc::address const& addr, uint8_t const* data, size_t data_size, evmc::bytes32 const topics[], size_t num_topics) noexcept override
+  {
+    record('L', addr.bytes, sizeof(addr.bytes));
+    for (size_t i = 0; i < num_topics; ++i)
+      record(topics[i].bytes, sizeof(topics[i].bytes));
+    record(data, data_size);
+  }
+
+  bytes const& journal() const noexcept { return m_journal; }
+
+private:
+  void record(char tag, uint8_t const* data, size_t size)
+  {
+    if (!m_journaling)
+      return;
+    m_journal.push_back(static_cast<uint8_t>(tag));
+    record(data, size);
+  }
+
+  void record(uint8_t const* data, size_t size)
+  {
+    if (!m_journaling)
+      return;
+    // Length prefixed, so different splits of the same bytes differ.
+    m_journal.append(reinterpret_cast<uint8_t const*>(&size), sizeof(size));
+    if (size)
+      m_journal.append(data, size);
+  }
+
+  bytes_view const m_code;
+  bool const m_journaling;
+  bytes m_journal;
+  std::map<std::pair<evmc::address, evmc::bytes32>, evmc::bytes32> m_storage;
+};
+
+}